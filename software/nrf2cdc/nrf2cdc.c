@@ -49,10 +49,137 @@
 //  t   set TX address    !t7B271F1F1F    addresses are 5 bytes, LSB first
 //  r   set RX address    !r41C355AA55    addresses are 5 bytes, LSB first
 //  s   set speed         !s02            data rate (00:250kbps, 01:1Mbps, 02:2Mbps)
+//  o   set options       !oADLx          upper case turns option on, lower case off
+//  d   set duty cycle    !d6402          listen 0x02 ms every 0x64 x 10 ms, !d00 off
+//  w   save settings     !w              write changed settings to data flash now
+//  P   store profile     !P02            store current settings as profile 0x02
+//  p   load profile      !p02            switch to settings of profile 0x02, error
+//                                        if the profile is not stored
+//  a   set destination   !a037B271F1F1F  set destination 0x03 (0x01 - 0x0F) for
+//                                        binary mode, not saved, no reply
+//  i   task statistics   !i              print runs and max run time of each task
+//                                        and restart them (text mode only)
+//
+// Options: A: auto ACK, D: dynamic payload, L: strip line-ends, X: hex mode (input
+//          and output of payloads as hex strings),
+//          B: binary mode (framed protocol, see below),
+//          R: raw stream mode (see below),
+//          W: wake on packet (see below),
+//          P: burst mode for duty-cycled receivers (see below)
 //
 // Enter just the exclamation mark ('!') for the actual NRF settings to be printed
 // in the serial monitor. The selected settings are saved in the data flash and are
-// retained even after a restart.
+// retained even after a restart. To keep commands fast, changed settings are saved
+// FLASH_DELAY ms after the last change, when the host suspends the bus or with the
+// 'w' command; the printout shows whether they are saved yet. Only changed settings
+// are written, as CRC-checked records at rotating positions, so a power loss while
+// saving keeps the previous settings and frequent changes don't wear out the data
+// flash.
+//
+// Up to NRF_PROFILES sets of channel, addresses, speed and options can be stored as
+// numbered profiles with the 'P' command. The 'p' command switches to a stored
+// profile with a single reconfiguration of the NRF, e.g. for a gateway talking to
+// several peers in turn. Binary and raw mode are kept when switching.
+//
+// Binary Mode:
+// ------------
+// In binary mode, all data between host and device is exchanged as COBS-encoded
+// frames, each terminated by a zero byte. The first byte of a decoded frame is the
+// header (upper nibble: frame type, lower nibble: pipe number), followed by the
+// payload:
+//
+// type  direction       payload
+// -----------------------------------------------------------------------------------
+// 0x1   host <-> device data to send via NRF / data received via NRF (host ->
+//                       device: lower nibble selects destination, see below)
+// 0x2   device -> host  length of sent data, credits (2 bytes), when transmission
+//                       is finished (length 0: frame rejected, see below)
+// 0x3   device -> host  channel, speed, TX address (5), RX address (5), options,
+//                       config, status and FIFO status register, TX queue size,
+//                       credits, duty cycle period and window, settings not saved
+//                       yet, command failed (e.g. profile not stored) (22 bytes)
+// 0x4   host -> device  command string without '!', e.g. "c2A" or "ob"
+// 0x5   host -> device  token (1 byte) chosen by the host + data to send via NRF
+// 0x6   device -> host  TX completion event for frame type 0x5: token, outcome
+//                       (0:ACKed, 1:failed, 2:sent without ACK, 3:rejected),
+//                       number of retransmits, timestamp in ms (2 bytes, LSB
+//                       first), credits
+//
+// Data to be sent is queued (TX_QUEUE_SIZE packets), so the host can keep several
+// transmissions in flight and match the completion events by their tokens. The
+// credits are the number of free TX queue slots at the time of the report. A host
+// that never has more data frames in flight than the last reported credits plus
+// the frames completed since, runs at the rate of the radio without stalling the
+// USB transfer. Data frames sent while the queue is full are not lost, but the
+// device stops accepting USB data until a slot becomes free. Data frames with more
+// than 32 bytes of data are rejected at once (ACK with length 0 or outcome 3),
+// empty ones are ignored.
+//
+// The lower nibble of the header of data frames (types 0x1 and 0x5) from the host
+// selects the destination: 0 sends to the configured TX address, 1 - 15 to the
+// addresses set with the 'a' command. The NRF's TX address is switched right
+// before transmission, without reconfiguration, so a hub can address many nodes
+// in turn at full packet rate.
+//
+// Send the command frame "ob" to return to text mode.
+//
+// Event Notifications:
+// --------------------
+// Independent of the mode, state changes are signaled as CDC SERIAL_STATE
+// notifications via the interrupt endpoint EP1, so host software can react without
+// parsing the data stream (e.g. TIOCMIWAIT/TIOCGICOUNT on Linux):
+//
+// signal      meaning
+// -----------------------------------------------------------------------------------
+// DCD         link up: last transmission was ACKed or data was received
+// DSR         credits: TX queue has free slots
+// RI          event: data received via NRF was passed to the host
+// framing     event: transmission finished
+// overrun     event: RX FIFO of the NRF was full, data may have been lost
+//
+// Raw Stream Mode:
+// ----------------
+// In raw stream mode, the device acts as a transparent serial cable replacement.
+// Data from the host is sent via NRF in packets of max payload size or, if less
+// data is available, after an idle time of RAW_TIMEOUT ms. Full payloads are sent
+// straight from the USB buffer, slicing each USB packet in place. Received payloads
+// are passed to the host exactly as they arrived, without any header or escaping.
+// Send a BREAK (e.g. tcsendbreak()) to return to text mode.
+//
+// USB Suspend:
+// ------------
+// When the host suspends the USB bus, queued packets are sent first. Then the NRF is
+// powered down and the MCU goes to sleep until the host resumes the bus. With the
+// wake on packet option, the NRF keeps listening instead (the MCU stays awake, as
+// the NRF IRQ pin cannot wake it up) and a received packet triggers a USB remote
+// wakeup, if the host has enabled it. The packet is passed to the host after the
+// bus has been resumed.
+//
+// Duty Cycle:
+// -----------
+// For occasional data, the receiver can be duty-cycled with the 'd' command: the NRF
+// only listens for a short RX window (01 - FE ms) once every period (01 - FE x 10 ms)
+// and stays in standby between, driven by the millisecond timer. The window is
+// extended as long as packets are received. A sender with burst mode (option P) and
+// the same period repeats each packet until it is ACKed or for one full period plus
+// window, so it hits an RX window of the receiver. Without auto ACK, the receiver
+// gets the repeated packets several times. The duty cycle is also used during USB
+// suspend with wake on packet.
+//
+// Firmware Variants:
+// ------------------
+// Besides the full firmware described above, specialized variants can be built with
+// 'make VARIANT=...' (see src/config.h). They leave out the code of the modes they
+// don't have, which saves code space and per-byte mode checks:
+//
+// variant  description
+// -----------------------------------------------------------------------------------
+// full     all modes and commands (default)
+// raw      raw stream bridge with a TX queue of 8 packets; after a BREAK, the
+//          device only takes commands (received payloads are still passed on as
+//          is), '!oR' returns to raw stream mode
+// sniffer  receive only: payloads are printed as text or hex lines, no TX queue,
+//          lines not starting with a command are discarded
 
 
 // ===================================================================================
@@ -64,38 +191,120 @@
 #include "src/system.h"                   // system functions
 #include "src/gpio.h"                     // GPIO functions
 #include "src/delay.h"                    // delay functions
+#include "src/timer.h"                    // millisecond timer functions
 #include "src/flash.h"                    // data flash functions
+#include "src/journal.h"                  // settings journal in data flash
 #include "src/usb_cdc.h"                  // USB-CDC serial functions
+#include "src/frame.h"                    // framed binary protocol
+#include "src/pool.h"                     // packet pool
+#include "src/task.h"                     // task scheduler
 #include "src/nrf24l01.h"                 // nRF24L01+ functions
 
-// Prototypes for used interrupts
-void USB_interrupt(void);
-void USB_ISR(void) __interrupt(INT_NO_USB) {
-  USB_interrupt();
+#if (FEATURE_BINARY || FEATURE_RAW) && !FEATURE_TX
+  #error "Binary and raw stream mode need FEATURE_TX"
+#endif
+#if !(FEATURE_TEXT || FEATURE_RAW)
+  #error "Received payloads need text or raw stream mode"
+#endif
+
+// Interrupt service routines. The USB and timer2 ISRs run in their own register
+// banks together with all functions they call, so R0-R7 of the main program don't
+// have to be saved. Completed bulk transfers on EP2 (the data stream) are handled
+// right here, all other USB events by the generic handler. Other events pending at
+// the same time (suspend, bus reset) trigger the interrupt again.
+void USB_ISR(void) __interrupt(INT_NO_USB) __using(USB_BANK) {
+  if(UIF_TRANSFER && ((USB_INT_ST & MASK_UIS_ENDP) == 2)) {
+    if((USB_INT_ST & MASK_UIS_TOKEN) == UIS_TOKEN_IN)
+      CDC_EP2_IN();                             // bulk IN transfer completed
+    else CDC_EP2_OUT();                         // bulk OUT transfer completed
+    UIF_TRANSFER = 0;                           // clear interrupt flag
+  }
+  else USB_interrupt();                         // setup, EP0, EP1, suspend, reset
 }
 
-void NRF_interrupt(void);
 void NRF_ISR(void) __interrupt(INT_NO_GPIO) {
-  NRF_interrupt();
+  NRF_interrupt();                              // only sets a bit, no bank needed
+}
+
+void TMR_ISR(void) __interrupt(INT_NO_TMR2) __using(TMR_BANK) {
+  TMR_interrupt();
+  NRF_tick();
 }
 
+// Options the firmware variant supports
+#define OPT_AVAILABLE   (STRIP_LINE_ENDS | AUTO_ACK | DYNAMIC_PAYLOAD | WAKE_ON_PACKET \
+                        | (FEATURE_HEX    ? HEX_MODE    : 0) \
+                        | (FEATURE_BINARY ? BINARY_MODE : 0) \
+                        | (FEATURE_RAW    ? RAW_MODE    : 0) \
+                        | (FEATURE_TX     ? BURST_MODE  : 0))
+
 // Global variables
-__xdata uint8_t buffer[NRF_PAYLOAD];      // rx/tx buffer
+__xdata uint8_t buffer[NRF_PAYLOAD];      // rx buffer, commands and settings
+
+#if FEATURE_TX
+// How to report the result of a transmission (type field of the packet block)
+#define TXQ_REPORT_NONE   0                         // raw mode: no report
+#define TXQ_REPORT_TEXT   1                         // text mode: "Sent 0x.."
+#define TXQ_REPORT_ACK    2                         // binary mode: ACK frame
+#define TXQ_REPORT_DONE   3                         // binary mode: completion event
+#define TXQ_REPORT_DIRECT 4                         // raw mode: sent directly, no report
+                                                    // and no payload in the block
+#endif
+
+// Event notification flags (SERIAL_STATE bits sent via EP1)
+#define EVT_LINK          CDC_STATE_DCD             // state: link up
+#define EVT_CREDITS       CDC_STATE_DSR             // state: TX queue has free slots
+#define EVT_RX            CDC_STATE_RING            // event: data passed to host
+#define EVT_TX            CDC_STATE_FRAMING         // event: transmission finished
+#define EVT_OVERFLOW      CDC_STATE_OVERRUN         // event: RX FIFO was full
+
+// Event notification variables (checked every loop, kept in internal RAM)
+uint8_t EVT_flags = 0;                              // link state + pending events
+uint8_t EVT_sent  = 0;                              // last notified state
+
+#if FEATURE_TX
+// TX queue variables (packet blocks from the pool, queue in internal RAM)
+pool_queue_t     TXQ = POOL_QUEUE;                  // queued packets, first is sent next
+#define TXQ_count (TXQ.count)                       // number of queued packets
+__xdata uint16_t TXQ_time  = 0;                     // start time of current packet
+__bit TXQ_busy = 0;                                 // transmission in progress
+#if FEATURE_BINARY
+__xdata uint8_t TXQ_frame[6];                       // report frames (buffer may hold
+#endif                                              // a command during TXQ_flush())
+
+// Destination table (index 1 ... DST_TABLE_SIZE, 0 is the configured TX address)
+__xdata uint8_t DST_table[DST_TABLE_SIZE][5];       // destination addresses
+__xdata uint8_t DST_current = 0;                    // destination set in NRF
+#else
+#define TXQ_count         0                         // receive only: queue always empty
+#define TXQ_busy          0
+#endif
+
+// Data flash variables
+__bit FLASH_dirty = 0;                              // settings not saved yet
 
 // ===================================================================================
 // Print Functions and String Conversions
 // ===================================================================================
 
+// Hex conversion tables
+__code char HEX_CHAR[] = "0123456789ABCDEF";      // nibble -> hex character
+__code uint8_t HEX_VALUE[] = {                    // hex character - '0' -> nibble
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 0, 0, 0, 0, 0, //  '0' ... '?'
+  0,10,11,12,13,14,15, 0, 0, 0, 0, 0, 0, 0, 0, 0, //  '@' ... 'O'
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, //  'P' ... '_'
+  0,10,11,12,13,14,15                             //  '`' ... 'f'
+};
+
 // Convert byte nibble into hex character and print via CDC
 void CDC_printNibble(uint8_t nibble) {
-  (nibble <= 9) ? (nibble += '0') : (nibble += ('A' - 10));
-  CDC_write(nibble);
+  CDC_write(HEX_CHAR[nibble]);
 }
 
 // Convert byte into hex string and print via CDC
 void CDC_printByte(uint8_t value) {
-  CDC_printNibble (value >> 4);
-  CDC_printNibble (value & 0x0F);
+  CDC_write(HEX_CHAR[value >> 4]);
+  CDC_write(HEX_CHAR[value & 0x0F]);
 }
 
 // Convert an array of bytes into hex string and print via CDC
@@ -103,12 +312,29 @@ void CDC_printBytes(uint8_t *ptr, uint8_t len) {
   while(len--) CDC_printByte(*ptr++);
 }
 
-// Convert character representing a hex nibble into 4-bit value
+#if FEATURE_HEX
+// Convert bytes into hex string and write it directly into the CDC OUT buffer
+void CDC_printHex(__xdata uint8_t *buf, uint8_t len) {
+  __xdata uint8_t *ptr;
+  uint8_t cnt, i;
+  while(len) {
+    cnt = (len > (EP2_SIZE / 2)) ? (EP2_SIZE / 2) : len;
+    len -= cnt;
+    ptr = CDC_reserve(cnt << 1);                  // space for two chars per byte
+    for(i=cnt; i; i--) {
+      *ptr++ = HEX_CHAR[*buf >> 4];
+      *ptr++ = HEX_CHAR[*buf++ & 0x0F];
+    }
+    CDC_commit(cnt << 1);                         // append to OUT buffer
+  }
+}
+#endif
+
+// Convert character representing a hex nibble into 4-bit value (invalid: 0)
 uint8_t hexDigit(uint8_t c) {
-  if     ((c >= '0') && (c <= '9')) return(c - '0');
-  else if((c >= 'a') && (c <= 'f')) return(c - 'a' + 10);
-  else if((c >= 'A') && (c <= 'F')) return(c - 'A' + 10); 
-  return 0;
+  c -= '0';
+  if(c >= sizeof(HEX_VALUE)) return 0;
+  return HEX_VALUE[c];
 }
 
 // Convert string containing a hex byte into 8-bit value
@@ -125,6 +351,47 @@ void hexAddress(uint8_t *sptr, uint8_t *aptr) {
   }
 }
 
+#if FEATURE_TEXT
+// Print received payload in buffer as escaped text (hex mode: hex string) via CDC
+void CDC_printPayload(uint8_t len) {
+  uint8_t ptr = 0;
+  uint8_t run;
+  uint8_t ch;
+  CDC_print("Read 0x"); CDC_printByte(len); CDC_write('\n');
+
+  // hex mode: print hex string that can be sent back as is
+  #if FEATURE_HEX
+  if(options & HEX_MODE) {
+    CDC_printHex(buffer, len);
+    CDC_write('\n');
+    CDC_flush();                                    // flush CDC
+    return;
+  }
+  #endif
+
+  // write runs of printable chars in one go, escape unprintable
+  while(ptr < len) {
+    run = ptr;
+    do {
+      ch = buffer[run];
+      if(((ch < 0x20) || (ch > 0x7f)) && (ch != '\r') && (ch != '\n')) break;
+    } while(++run < len);
+    if(run > ptr) {                                 // printable run?
+      CDC_writeBuffer(buffer + ptr, run - ptr);     // -> write it at once
+      ptr = run;
+    }
+    else {                                          // unprintable char?
+      CDC_write('\\');                              // -> escape it
+      CDC_printByte(ch);
+      ptr++;
+    }
+  }
+  if(!len || (buffer[len - 1] != '\n'))            // add a newline if we didn't
+    CDC_write('\n');                               // end with one
+  CDC_flush();                                      // flush CDC
+}
+#endif
+
 // Print the current NRF settings via CDC
 void CDC_printSettings(void) {
   uint8_t cfg_reg = NRF_readconfig();
@@ -134,6 +401,11 @@ void CDC_printSettings(void) {
   CDC_print  ("# TX address: "); CDC_printBytes(NRF_tx_addr, 5); CDC_write('\n');
   CDC_print  ("# RX address: "); CDC_printBytes(NRF_rx_addr, 5); CDC_write('\n');
   CDC_print  ("# Data rate:  "); CDC_print(NRF_STR[NRF_speed]);  CDC_println("bps");
+  CDC_print  ("# Settings:   "); CDC_println(FLASH_dirty ? "not saved yet" : "saved");
+  if(NRF_period) {
+    CDC_print("# Duty cycle: RX "); CDC_printByte(NRF_window);
+    CDC_print(" ms every ");        CDC_printByte(NRF_period); CDC_println(" x 10 ms");
+  }
   CDC_print ("Config register: "); CDC_printByte(cfg_reg); CDC_write('\n');
   CDC_print ("Status register: "); CDC_printByte(status_reg); CDC_write('\n');
   CDC_print ("FIFO Status register: "); CDC_printByte(NRF_readfifostatus()); CDC_write('\n');
@@ -142,77 +414,448 @@ void CDC_printSettings(void) {
     if(options & HEX_MODE) CDC_print (" Hex mode,");
     if(options & STRIP_LINE_ENDS) CDC_print (" Strip line-ends,");
     if(options & AUTO_ACK) CDC_print (" Auto ACK,");
-    if(options & DYNAMIC_PAYLOAD) CDC_print(" Dynamic payload");
+    if(options & DYNAMIC_PAYLOAD) CDC_print(" Dynamic payload,");
+    if(options & BINARY_MODE) CDC_print(" Binary mode,");
+    if(options & RAW_MODE) CDC_print(" Raw mode,");
+    if(options & WAKE_ON_PACKET) CDC_print(" Wake on packet,");
+    if(options & BURST_MODE) CDC_print(" Burst mode");
     CDC_write('\n');
   }
   CDC_flush();
 }
 
-void NRF_interrupt()
-{
-  CDC_write('@');
+#if TASK_STATS
+// Print the run statistics of the tasks via CDC
+__code uint8_t* TASK_STR[] = {"radio", "USB out", "USB in", "command", "housekeeping"};
+void CDC_printTasks(void) {
+  uint8_t t;
+  CDC_println("# Task runs and max run time (x 4/F_CPU):");
+  for(t=0; t<TASKS; t++) {
+    CDC_print("# ");
+    CDC_printByte(TASK_runs[t] >> 8);    CDC_printByte(TASK_runs[t]);    CDC_write(' ');
+    CDC_printByte(TASK_maxTime[t] >> 8); CDC_printByte(TASK_maxTime[t]); CDC_write(' ');
+    CDC_println(TASK_STR[t]);
+  }
+}
+#endif
+
+#if FEATURE_BINARY
+// Send the current NRF settings and the result of the command as status frame via CDC
+void CDC_sendSettings(uint8_t failed) {
+  uint8_t i;
+  buffer[0] = NRF_channel;
+  buffer[1] = NRF_speed;
+  for(i=0; i<5; i++) {
+    buffer[2+i] = NRF_tx_addr[i];
+    buffer[7+i] = NRF_rx_addr[i];
+  }
+  buffer[12] = options;
+  buffer[13] = NRF_readconfig();
+  buffer[14] = NRF_readstatus();
+  buffer[15] = NRF_readfifostatus();
+  buffer[16] = TX_QUEUE_SIZE;                       // TX queue size
+  buffer[17] = TX_QUEUE_SIZE - TXQ_count;           // credits: free queue slots
+  buffer[18] = NRF_period;                          // duty cycle period
+  buffer[19] = NRF_window;                          // duty cycle RX window
+  buffer[20] = FLASH_dirty;                         // settings not saved yet?
+  buffer[21] = failed;                              // command failed?
+  FRAME_send(FRAME_STAT, buffer, 22);
+}
+#endif
+
+// Report the current settings to the host (as status frame in binary mode) and
+// whether the command failed
+void CDC_reportSettings(uint8_t failed) {
+  #if FEATURE_BINARY
+  if(options & BINARY_MODE) {
+    CDC_sendSettings(failed);                       // send settings as frame
+    return;
+  }
+  #endif
+  if(failed) CDC_println("# Error: profile not available, settings unchanged");
+  CDC_printSettings();                              // print settings via CDC
+}
+
+// ===================================================================================
+// TX Queue Implementation
+// ===================================================================================
+#if FEATURE_TX
+
+// Report the result of a finished transmission to the host
+void TXQ_report(__xdata pool_block_t *slot, uint8_t status) {
+  uint16_t time;
+  switch(slot->type) {
+    #if FEATURE_TEXT
+    case TXQ_REPORT_TEXT:
+      CDC_print("Sent 0x"); CDC_printByte(slot->len); CDC_write('\n');
+      CDC_flush();
+      break;
+    #endif
+    #if FEATURE_BINARY
+    case TXQ_REPORT_ACK:
+      TXQ_frame[0] = slot->len;
+      TXQ_frame[1] = TX_QUEUE_SIZE - TXQ_count;     // credits: free queue slots
+      FRAME_send(FRAME_ACK, TXQ_frame, 2);
+      break;
+    case TXQ_REPORT_DONE:
+      time = TMR_millis();
+      TXQ_frame[0] = slot->token;
+      if(status & NRF_TX_FAILED)  TXQ_frame[1] = FRAME_TX_FAILED;
+      else if(options & AUTO_ACK) TXQ_frame[1] = FRAME_TX_ACKED;
+      else                        TXQ_frame[1] = FRAME_TX_NOACK;
+      TXQ_frame[2] = NRF_retransmits;
+      TXQ_frame[3] = (uint8_t)time;
+      TXQ_frame[4] = (uint8_t)(time >> 8);
+      TXQ_frame[5] = TX_QUEUE_SIZE - TXQ_count;     // credits: free queue slots
+      FRAME_send(FRAME_DONE, TXQ_frame, 6);
+      break;
+    #endif
+    default:
+      break;
+  }
+}
+
+// Finish current transmission and start the next one (call on NRF IRQ event)
+void TXQ_service(void) {
+  uint8_t status;
+  uint8_t blk;
+  __xdata pool_block_t *slot;
+  if(TXQ_busy) {                                    // transmission in progress?
+    status = NRF_pollTX();                          // check if finished
+    if(!status) return;                             // still busy -> come back later
+    slot = POOL_block(POOL_first(&TXQ));
+    if((options & BURST_MODE) && NRF_period         // burst until receiver listens:
+       && (slot->type != TXQ_REPORT_DIRECT)         // (only with payload in block)
+       && ((status & NRF_TX_FAILED) || !(options & AUTO_ACK))
+       && !TMR_timeout(TXQ_time, NRF_dutyTicks + NRF_window)) {
+      NRF_startTX(slot->data, slot->len);           // -> repeat packet
+      return;
+    }
+    TXQ_busy = 0;
+    blk = POOL_get(&TXQ);                           // remove packet from queue
+    TXQ_report(slot, status);                       // report result and credits
+    POOL_free(blk);                                 // return block to the pool
+    EVT_flags |= EVT_TX;                            // notify transmission finished
+    if(status & NRF_TX_FAILED)  EVT_flags &= ~EVT_LINK;
+    else if(options & AUTO_ACK) EVT_flags |=  EVT_LINK;
+  }
+  if(TXQ_count && NRF_ready()) {                    // more packets, NRF ready?
+    PIN_low(PIN_LED);                               // switch on LED
+    slot = POOL_block(POOL_first(&TXQ));
+    if(slot->dest != DST_current) {                 // other destination?
+      DST_current = slot->dest;                     // -> set its address
+      NRF_setTXaddress(DST_current ? DST_table[DST_current - 1] : NRF_tx_addr);
+    }
+    NRF_startTX(slot->data, slot->len);
+    TXQ_time = TMR_millis();                        // remember start time
+    TXQ_busy = 1;
+  }
+}
+
+// Get a block for a packet to be queued (waits if the queue is full). There is one
+// block more than queue slots, so this never fails while no other block is held
+uint8_t TXQ_alloc(void) {
+  while(TXQ_count == TX_QUEUE_SIZE) TXQ_service();  // wait for free slot
+  return POOL_alloc();
+}
+
+// Hand a filled block over to the TX queue
+void TXQ_submit(uint8_t blk, uint8_t report, uint8_t token, uint8_t dest,
+                uint8_t len) {
+  __xdata pool_block_t *slot = POOL_block(blk);
+  slot->type  = report;
+  slot->token = token;
+  slot->dest  = (dest > DST_TABLE_SIZE) ? 0 : dest;
+  slot->len   = len;
+  POOL_put(&TXQ, blk);                              // queue owns the block now
+  if(!TXQ_busy) TXQ_service();                      // radio idle -> start sending
+}
+
+#if FEATURE_BINARY
+// Report a data frame from the host that can't be sent (payload too long) at once
+void TXQ_reject(uint8_t report, uint8_t token) {
+  uint16_t time;
+  if(report == TXQ_REPORT_ACK) {
+    TXQ_frame[0] = 0;                               // nothing sent
+    TXQ_frame[1] = TX_QUEUE_SIZE - TXQ_count;       // credits: free queue slots
+    FRAME_send(FRAME_ACK, TXQ_frame, 2);
+    return;
+  }
+  time = TMR_millis();
+  TXQ_frame[0] = token;
+  TXQ_frame[1] = FRAME_TX_INVALID;
+  TXQ_frame[2] = 0;                                 // no retransmits
+  TXQ_frame[3] = (uint8_t)time;
+  TXQ_frame[4] = (uint8_t)(time >> 8);
+  TXQ_frame[5] = TX_QUEUE_SIZE - TXQ_count;         // credits: free queue slots
+  FRAME_send(FRAME_DONE, TXQ_frame, 6);
+}
+
+// Add a copy of a packet to the TX queue (waits if the queue is full)
+void TXQ_push(uint8_t report, uint8_t token, uint8_t dest,
+              __xdata uint8_t *buf, uint8_t len) {
+  uint8_t blk = TXQ_alloc();
+  __xdata uint8_t *ptr = POOL_data(blk);
+  uint8_t i;
+  if(len > NRF_PAYLOAD) len = NRF_PAYLOAD;          // never beyond the block
+  for(i=len; i; i--) *ptr++ = *buf++;               // copy payload
+  TXQ_submit(blk, report, token, dest, len);
+}
+#endif
+
+#if FEATURE_RAW
+// Check if a payload can be sent directly (queue empty and NRF ready)
+#define TXQ_directReady()   (!TXQ_count && NRF_ready())
+
+// Send a raw payload directly from buf (e.g. the USB buffer) without copying it into
+// the queue, the NRF TX FIFO holds it afterwards. Only possible if the queue is empty
+// and the NRF ready and no burst is needed, returns 0 otherwise
+uint8_t TXQ_sendDirect(__xdata uint8_t *buf, uint8_t len) {
+  uint8_t blk;
+  __xdata pool_block_t *slot;
+  if(!TXQ_directReady()) return 0;                  // queue or NRF busy?
+  if((options & BURST_MODE) && NRF_period) return 0; // repeats need a copy
+  PIN_low(PIN_LED);                                 // switch on LED
+  if(DST_current) {                                 // other destination?
+    DST_current = 0;                                // -> set TX address
+    NRF_setTXaddress(NRF_tx_addr);
+  }
+  blk  = POOL_alloc();                              // occupy slot without payload
+  slot = POOL_block(blk);
+  slot->type = TXQ_REPORT_DIRECT;                   // no payload to repeat
+  slot->dest = 0;
+  slot->len  = len;
+  POOL_put(&TXQ, blk);
+  NRF_startTX(buf, len);                            // write payload to NRF
+  TXQ_time = TMR_millis();                          // remember start time
+  TXQ_busy = 1;
+  return 1;
+}
+#endif
+
+// Send all queued packets and wait until finished
+void TXQ_flush(void) {
+  while(TXQ_count) TXQ_service();
+}
+
+#else
+#define TXQ_service()                               // receive only: nothing to send
+#define TXQ_flush()
+#endif
+
+// ===================================================================================
+// Event Notifications
+// ===================================================================================
+
+// Get state to be notified (link state, credits and pending events)
+uint8_t EVT_state(void) {
+  uint8_t state = EVT_flags;
+  #if FEATURE_TX
+  if(TXQ_count < TX_QUEUE_SIZE) state |= EVT_CREDITS;
+  #endif
+  return state;
+}
+
+// Send SERIAL_STATE notification via EP1 if state changed or events are pending
+void EVT_service(void) {
+  uint8_t state = EVT_state();
+  if((state != EVT_sent) && CDC_notify(state)) {    // changed and EP1 ready?
+    EVT_sent   = state & (EVT_LINK | EVT_CREDITS);  // remember state
+    EVT_flags &= EVT_LINK;                          // events are sent only once
+  }
+}
+
+// Note received data and check for RX FIFO overflow (call before reading payload)
+void EVT_receive(void) {
+  EVT_flags |= EVT_LINK | EVT_RX;                   // link up, data received
+  if(NRF_readfifostatus() & 0x02) EVT_flags |= EVT_OVERFLOW; // RX FIFO full?
+}
+
+// ===================================================================================
+// USB Suspend Handling
+// ===================================================================================
+
+// Power down NRF and sleep, or listen and wake up the host, until bus is resumed.
+// With wake on packet, the MCU polls the IRQ pin instead of sleeping: the pin can't
+// wake it from power down and the CH55x has no idle mode. The loop only reads the
+// pin (no SPI); the NRF's RX current dominates anyway, see README (USB Suspend)
+void SUSP_handle(void) {
+  uint8_t woken = 0;
+  uint16_t start = TMR_millis();                    // suspended since at least now
+  if(!(USB_MIS_ST & bUMS_SUSPEND)) return;          // already resumed?
+  PIN_high(PIN_LED);                                // switch off LED
+  if(options & WAKE_ON_PACKET) {                    // wake on packet?
+    while(USB_MIS_ST & bUMS_SUSPEND) {              // NRF keeps listening
+      if(!woken && !PIN_read(PIN_IRQ)               // packet received and bus idle
+         && TMR_timeout(start, WAKE_DELAY))         // long enough for resume?
+        woken = USB_wakeup();                       // -> wake up the host
+      WDT_reset();                                  // reset watchdog
+    }
+  }
+  else {
+    NRF_powerDown();                                // power down NRF
+    while(USB_MIS_ST & bUMS_SUSPEND) {              // until bus is resumed:
+      SAFE_MOD  = 0x55;
+      SAFE_MOD  = 0xAA;
+      WAKE_CTRL = bWAK_BY_USB;                      // enable wakeup by USB
+      SLEEP_now();                                  // power down MCU
+      WDT_reset();                                  // reset watchdog
+    }
+    SAFE_MOD  = 0x55;
+    SAFE_MOD  = 0xAA;
+    WAKE_CTRL = 0;                                  // disable wakeup by USB
+    NRF_powerRX();                                  // return to listening
+  }
 }
 
 // ===================================================================================
 // Data Flash Implementation
 // ===================================================================================
 
-typedef struct {
-  char    f_ident[2];
-  uint8_t f_channel;
-  uint8_t f_speed;
-  char    f_tx_address[5];
-  char    f_rx_address[5];
-  uint8_t f_options;
-} flash_t;
+// Record keys in settings journal
+#define KEY_SETTINGS      1                         // channel, speed, addresses, options
+#define KEY_DUTY          2                         // duty cycle period and window
+#define KEY_PROFILE       3                         // radio profiles (like KEY_SETTINGS)
 
+// Offsets of the settings in the data flash before the journal was introduced
 typedef enum {
   fo_ident = 0,
   fo_channel = 2,
   fo_speed = 3,
   fo_tx_address = 4,
   fo_rx_address = 9,
-  fo_options = 15
+  fo_options = 15,
+  fo_period = 16,
+  fo_window = 17
 } flash_offsets_t;
 
-// FLASH write user settings
-void FLASH_writeSettings(void) {
+// Copy radio settings into buffer (record of KEY_SETTINGS or KEY_PROFILE)
+void FLASH_packSettings(void) {
   uint8_t i;
-  FLASH_update(fo_channel, NRF_channel);
-  FLASH_update(fo_speed, NRF_speed);
+  buffer[0] = NRF_channel;
+  buffer[1] = NRF_speed;
   for(i=0; i<5; i++) {
-    FLASH_update(fo_tx_address+i, NRF_tx_addr[i]);
-    FLASH_update(fo_rx_address+i, NRF_rx_addr[i]);
+    buffer[2+i] = NRF_tx_addr[i];
+    buffer[7+i] = NRF_rx_addr[i];
   }
-  FLASH_update(fo_options, options);
+  buffer[12] = options;
 }
 
-// FLASH read user settings; if FLASH values are invalid, write defaults
+// Copy radio settings from buffer (record of KEY_SETTINGS or KEY_PROFILE)
+void FLASH_unpackSettings(void) {
+  uint8_t i;
+  NRF_channel = buffer[0];
+  NRF_speed   = buffer[1];
+  for(i=0; i<5; i++) {
+    NRF_tx_addr[i] = buffer[2+i];
+    NRF_rx_addr[i] = buffer[7+i];
+  }
+  options = buffer[12] & OPT_AVAILABLE;
+}
+
+// FLASH write user settings (only changed records are written)
+void FLASH_writeSettings(void) {
+  uint8_t i;
+  FLASH_packSettings();
+  JRN_write(KEY_SETTINGS, buffer);
+  buffer[0] = NRF_period;
+  buffer[1] = NRF_window;
+  for(i=2; i<JRN_DATA; i++) buffer[i] = 0;          // unused, so it stays unchanged
+  JRN_write(KEY_DUTY, buffer);
+}
+
+// FLASH read user settings; convert old layout or write defaults if there are none
 void FLASH_readSettings(void) {
   uint8_t i;
   uint16_t identifier = ((uint16_t)FLASH_read(1) << 8) | FLASH_read(0);
-  if (identifier == FLASH_IDENT) {
-    NRF_channel =  FLASH_read(fo_channel);
-    NRF_speed   =  FLASH_read(fo_speed);
-    for(i=0; i<5; i++) {
-      NRF_tx_addr[i] = FLASH_read(fo_tx_address+i);
-      NRF_rx_addr[i] = FLASH_read(fo_rx_address+i);
+  JRN_init();
+  if(JRN_read(KEY_SETTINGS, buffer)) {
+    FLASH_unpackSettings();
+    if(JRN_read(KEY_DUTY, buffer)) {
+      NRF_period = buffer[0];
+      NRF_window = buffer[1];
     }
-    options = FLASH_read(fo_options);
   }
   else {
-    FLASH_update(0, (uint8_t)FLASH_IDENT);
-    FLASH_update(1, (uint8_t)(FLASH_IDENT >> 8));
-    FLASH_writeSettings();
+    if(identifier == FLASH_IDENT) {                 // settings in old layout?
+      NRF_channel = FLASH_read(fo_channel);
+      NRF_speed   = FLASH_read(fo_speed);
+      for(i=0; i<5; i++) {
+        NRF_tx_addr[i] = FLASH_read(fo_tx_address+i);
+        NRF_rx_addr[i] = FLASH_read(fo_rx_address+i);
+      }
+      options = FLASH_read(fo_options) & OPT_AVAILABLE;
+      NRF_period = FLASH_read(fo_period);
+      NRF_window = FLASH_read(fo_window);
+      if(!NRF_window || (NRF_window == 0xFF)) {     // not written yet?
+        NRF_period = 0;                             // -> continuous RX
+        NRF_window = 2;
+      }
+    }
+    FLASH_writeSettings();                          // write journal records
   }
 }
 
+// FLASH store radio settings as profile
+void FLASH_storeProfile(uint8_t profile) {
+  FLASH_packSettings();
+  JRN_write(KEY_PROFILE + profile, buffer);
+}
+
+// FLASH load radio settings from profile (host link mode is kept), 0 if not stored
+uint8_t FLASH_loadProfile(uint8_t profile) {
+  uint8_t mode = options & (BINARY_MODE | RAW_MODE);
+  if(!JRN_read(KEY_PROFILE + profile, buffer)) return 0;
+  FLASH_unpackSettings();
+  options = (options & ~(BINARY_MODE | RAW_MODE)) | mode;
+  return 1;
+}
+
+// FLASH note changed settings, they are saved after FLASH_DELAY ms without changes
+void FLASH_markDirty(void) {
+  TMR_start(TMR_FLASH, FLASH_DELAY);
+  FLASH_dirty = 1;
+}
+
+// FLASH save changed settings now
+void FLASH_commit(void) {
+  if(!FLASH_dirty) return;
+  FLASH_writeSettings();
+  FLASH_dirty = 0;
+}
+
 // ===================================================================================
 // Command Parser
 // ===================================================================================
 void parse(void) {
   uint8_t cmd = buffer[1];                          // read the command
-  switch(cmd) {                                     // what command?
+  uint8_t arg;                                      // command argument
+  uint8_t failed = 0;                               // command could not be executed
+  switch(cmd) {                                     // commands without reconfiguration
+    case 'w': FLASH_commit();                       // save settings now
+              CDC_reportSettings(0);
+              return;
+    #if FEATURE_TX
+    case 'a': arg = hexByte(buffer + 2);            // set destination address:
+              if(arg && (arg <= DST_TABLE_SIZE)) {  // only the table is changed,
+                hexAddress(buffer + 4, DST_table[arg - 1]); // no reconfiguration
+                if(arg == DST_current) DST_current = 0xFF;  // reload before next TX
+              }
+              return;
+    #endif
+    #if TASK_STATS
+    case 'i': if(!(options & BINARY_MODE)) CDC_printTasks();
+              TASK_clearStats();
+              return;
+    #endif
+    case 'P': arg = hexByte(buffer + 2);
+              if(arg < NRF_PROFILES) FLASH_storeProfile(arg);
+              CDC_reportSettings(arg >= NRF_PROFILES); // current settings unchanged
+              return;
+    default:  break;
+  }
+  TXQ_flush();                                      // send queued packets first, with
+  switch(cmd) {                                     // the settings they were queued with
     case 'c': NRF_channel = hexByte(buffer + 2) & 0x7F;
               break;
     case 't': hexAddress(buffer + 2, NRF_tx_addr);
@@ -222,6 +865,17 @@ void parse(void) {
     case 's': NRF_speed = hexByte(buffer + 2);
               if(NRF_speed > 2) NRF_speed = 2;
               break;
+    case 'd': NRF_period = hexByte(buffer + 2);
+              NRF_window = hexByte(buffer + 4);
+              if(!NRF_window) NRF_window = 1;
+              if(NRF_window == 0xFF) NRF_window = 0xFE;
+              break;
+    case 'p': arg = hexByte(buffer + 2);
+              if((arg >= NRF_PROFILES) || !FLASH_loadProfile(arg)) {
+                failed = 1;                         // profile not stored:
+                cmd    = 0;                         // settings unchanged
+              }
+              break;
     case 'o': for(char *ptr=&buffer[2]; *ptr != '\0'; ++ptr) {
                 switch(*ptr) {
                   case 'l': options &= ~STRIP_LINE_ENDS; break;
@@ -232,10 +886,19 @@ void parse(void) {
                   case 'A': options |=  AUTO_ACK; break;
                   case 'd': options &= ~DYNAMIC_PAYLOAD; break;
                   case 'D': options |=  DYNAMIC_PAYLOAD; break;
+                  case 'b': options &= ~BINARY_MODE; break;
+                  case 'B': options |=  BINARY_MODE; options &= ~RAW_MODE; break;
+                  case 'r': options &= ~RAW_MODE; break;
+                  case 'R': options |=  RAW_MODE; options &= ~BINARY_MODE; break;
+                  case 'w': options &= ~WAKE_ON_PACKET; break;
+                  case 'W': options |=  WAKE_ON_PACKET; break;
+                  case 'p': options &= ~BURST_MODE; break;
+                  case 'P': options |=  BURST_MODE; break;
                   default: goto endoptions;
                 }
               }
               endoptions:
+              options &= OPT_AVAILABLE;             // modes of other variants
               break;
     /*
     case '>': NRF_powerTX();  // manually switch to TX mode for 200uS
@@ -245,112 +908,311 @@ void parse(void) {
     */
     default:  break;
   }
+  if(cmd) FLASH_markDirty();                        // save settings later
   NRF_configure();                                  // reconfigure the NRF
-  CDC_printSettings();                              // print settings via CDC
-  FLASH_writeSettings();                            // update settings in data flash
+  #if FEATURE_TX
+  DST_current = 0;                                  // NRF uses configured TX address
+  #endif
+  CDC_reportSettings(failed);                       // print or send settings
 }
 
 // ===================================================================================
-// Main Function
+// Frame Processing (Binary Mode)
 // ===================================================================================
-void main(void) {
-  // Variables
-  uint8_t buflen;                                   // data length in buffer
-  uint8_t bufptr;                                   // buffer pointer
+#if FEATURE_BINARY
+// Process a decoded frame from the host. len is the result of FRAME_receive(), for a
+// truncated frame (FRAME_TRUNCATED) it exceeds every limit, so it gets rejected
+void processFrame(uint8_t len) {
+  uint8_t i;
+  uint8_t type = FRAME_buffer[0] & FRAME_TYPE_MASK; // get frame type
+  uint8_t dest = FRAME_buffer[0] & FRAME_PIPE_MASK; // get destination
+  uint8_t report = TXQ_REPORT_ACK;                  // data frame: report ACK frame
+  uint8_t token  = 0;
+  __xdata uint8_t *ptr = FRAME_buffer + 1;          // payload
+  len--;                                            // payload length
+  if((type == FRAME_DATA) || (type == FRAME_SEND)) {// data frame?
+    if(type == FRAME_SEND) {                        // tagged data frame?
+      if(!len) return;                              // -> token missing
+      report = TXQ_REPORT_DONE;                     // -> report completion event
+      token  = *ptr++;
+      len--;
+    }
+    if(len > NRF_PAYLOAD) TXQ_reject(report, token);// too long for one packet
+    else if(len) TXQ_push(report, token, dest, ptr, len); // empty ones are dropped
+  }
+  else if((type == FRAME_CMD) && (len < FRAME_SIZE)) { // complete command frame?
+    if(len > NRF_PAYLOAD - 2) len = NRF_PAYLOAD - 2;// restrict command length
+    buffer[0] = CMD_IDENT;
+    for(i=0; i<len; i++) buffer[i+1] = FRAME_buffer[i+1];
+    buffer[len+1] = '\0';
+    parse();                                        // parse the command
+  }
+}
+#endif
 
-  // Setup
-  CLK_config();                                     // configure system clock
-  DLY_ms(5);                                        // wait for clock to settle
-  FLASH_readSettings();                             // read user settings from flash
-  CDC_init();                                       // init USB CDC
-  NRF_init();                                       // init nRF24L01+
-  WDT_start();                                      // start watchdog timer
+// ===================================================================================
+// Tasks
+// ===================================================================================
 
-  // Loop
-  while(1) {
+#if FEATURE_RAW
+// Raw stream mode variables
+uint8_t RAW_blk;                                    // block collecting raw data
+uint8_t RAW_len = 0;                                // data length in raw block
+
+// Full payload in the USB buffer, sent from there (waits until the radio is idle)
+#define RAW_direct()    (!RAW_len && (CDC_available() >= NRF_PAYLOAD) \
+                        && !((options & BURST_MODE) && NRF_period))
+#endif
+
+// Radio task: finish and start transmissions, drain RX FIFO
+void TASK_radio(void) {
+  uint8_t len;
+  if(NRF_irqFlag) {                                 // event on NRF IRQ pin?
+    NRF_irqFlag = 0;
+    if(TXQ_busy) TXQ_service();                     // finish transmission, start next
     if(NRF_available()) {                           // something coming in via NRF?
       PIN_low(PIN_LED);                             // switch on LED
-      bufptr = 0;                                   // reset buffer pointer
-      buflen = NRF_readPayload(buffer);             // read payload into buffer
-      CDC_print("Read 0x"); CDC_printByte(buflen); CDC_write('\n'); 
-
-      // escape unprintable
-      char ch;
-      while(buflen--) {
-        ch = buffer[bufptr++];
-        if(ch >= 0x20 && ch <= 0x7f) //printable
-          CDC_write(ch);
-        else if(ch == '\r' || ch == '\n')
-          CDC_write(ch);
-        else {
-          CDC_write('\\');
-          CDC_printByte(ch);
+      EVT_receive();                                // note received data
+      do {                                          // drain RX FIFO
+        #if FEATURE_RAW
+        if(!FEATURE_TEXT || (options & RAW_MODE)) { // raw mode? -> pass it on as is:
+          len = NRF_payloadLength();                // get payload length
+          NRF_fetchPayload(CDC_reserve(len), len);  // read directly into USB
+          CDC_commit(len);                          // append to USB packet
+          continue;
         }
-      }
-      if(ch != '\n')  // add a newline if we didn't end with one
-        CDC_write('\n');
+        #endif
+        #if FEATURE_BINARY
+        if(options & BINARY_MODE) {                 // binary mode? -> data frame:
+          len = NRF_payloadLength();                // get payload length
+          if(!len) continue;                        // skip corrupt payload
+          NRF_fetchPayload(FRAME_reserve(len), len);// read directly into USB
+          FRAME_commit(FRAME_DATA | NRF_pipe, len); // encode frame in place
+          continue;
+        }
+        #endif
+        #if FEATURE_TEXT
+        len = NRF_readPayload(buffer);              // text mode: read payload and
+        CDC_printPayload(len);                      // -> print payload as text
+        #endif
+      } while(NRF_available());
       CDC_flush();                                  // flush CDC
     }
+    if(!PIN_read(PIN_IRQ)) NRF_irqFlag = 1;         // new flag set meanwhile -> again
+  }
+  if(TXQ_count && !TXQ_busy) TXQ_service();         // start TX after NRF start-up
+}
+
+// Read an input line from USB into line, returns its length. Hex mode: pairs of hex
+// digits are converted into bytes
+uint8_t readLine(__xdata uint8_t *line, uint8_t hex) {
+  uint8_t len = CDC_available();                    // get number of bytes in CDC IN
+  uint8_t ptr = 0;                                  // line pointer
+  uint8_t ch;                                       // input character
+  #if FEATURE_HEX
+  if(hex) { // hex input
+    // read the input as hex digits, and truncating as below. Note invalid characters=>\0
+    if(len < 2) {                                   // no complete pair pending?
+      if(len) CDC_read();                           // -> discard single character
+      return 0;
+    }
+    ch = CDC_read();
+    line[ptr++] = (hexDigit(ch) << 4) + hexDigit(CDC_read()); // 1st byte
+    len -= 2;
+    uint8_t keep = !(options & STRIP_LINE_ENDS);    // keep line-ends?
 
-    buflen = CDC_available();                       // get number of bytes in CDC IN
-    uint8_t is_command;
-    if(buflen) {                                    // something coming in via USB?
-      bufptr = 0;                                   // reset output buffer pointer
-      buffer[bufptr++] = CDC_read();                // read 1st byte to check if it is a command
-      buflen--;
-      is_command = (buffer[0] == CMD_IDENT); 
-      if(!is_command && (options & HEX_MODE)) { // hex input
-        // read the input as hex digits, and truncating as below. Note invalid characters=>\0
-        buffer[0] = (hexDigit(buffer[0]) << 4) + hexDigit(CDC_read()); // redo the 1st byte
-        buflen--;
-
-        while(1) {
-          // basically pull in pairs, but \r and \n must be handled specially
-          if(buflen == 0) break; char ch1 = CDC_read(); buflen--;
-          if(ch1 == '\r' || ch1 == '\n') {
-            //CDC_write('#');
-            if((options & STRIP_LINE_ENDS) == 0) {
-              //CDC_write('^');
-              buffer[bufptr++] = ch1; if(bufptr >= NRF_PAYLOAD) break;
-            }
-            continue;
-          }
-
-          if(buflen == 0) break; char ch2 = CDC_read(); buflen--;
-          if(ch2 == '\r' || ch2 == '\n') {
-            buffer[bufptr++] = hexDigit(ch1) << 4; if(bufptr >= NRF_PAYLOAD) break;
-            if((options & STRIP_LINE_ENDS) == 0) {
-              buffer[bufptr++] = ch2; if(bufptr >= NRF_PAYLOAD) break;
-            }
-            continue;
-          }
-          buffer[bufptr++] = (hexDigit(ch1) << 4) + hexDigit(ch2);
-          if(bufptr >= NRF_PAYLOAD) break;
+    while(1) {
+      // basically pull in pairs, but \r and \n must be handled specially
+      if(len == 0) break; char ch1 = CDC_read(); len--;
+      if(ch1 == '\r' || ch1 == '\n') {
+        if(keep) {
+          line[ptr++] = ch1; if(ptr >= NRF_PAYLOAD) break;
         }
-      } else { // normal input
-        if(buflen > NRF_PAYLOAD-1) buflen = NRF_PAYLOAD-1; // restrict length to max payload. First byte already buffered
-        while(buflen--) {
-          char ch = CDC_read(); // get data from CDC
-          if(ch != '\r' && ch != '\n')            // output non-lineend character
-            buffer[bufptr++] = ch;
-          else if((options & STRIP_LINE_ENDS) == 0) // output lineend if we aren't stripping
-            buffer[bufptr++] = ch;// get data from CDC
-          }
+        continue;
       }
 
-      if(is_command) {
-        buffer[bufptr] = '\0';
-        parse();           // is it a command? -> parse
-      } else {                                        // not a command?
-        PIN_low(PIN_LED);                           // switch on LED
-        //CDC_write('>');
-        NRF_writePayload(buffer, bufptr);           // send the buffer via NRF
-        CDC_print("Sent 0x"); CDC_printByte(bufptr); CDC_write('\n'); 
-        CDC_flush();
+      if(len == 0) break; char ch2 = CDC_read(); len--;
+      if(ch2 == '\r' || ch2 == '\n') {
+        line[ptr++] = hexDigit(ch1) << 4; if(ptr >= NRF_PAYLOAD) break;
+        if(keep) {
+          line[ptr++] = ch2; if(ptr >= NRF_PAYLOAD) break;
+        }
+        continue;
       }
+      line[ptr++] = (hexDigit(ch1) << 4) + hexDigit(ch2);
+      if(ptr >= NRF_PAYLOAD) break;
+    }
+    return ptr;
+  }
+  #endif
+  // normal input
+  if(len > NRF_PAYLOAD) len = NRF_PAYLOAD;          // restrict length to max payload
+  if(options & STRIP_LINE_ENDS) {                   // strip line-ends:
+    while(len--) {
+      ch = CDC_read();                              // get data from CDC
+      if(ch != '\r' && ch != '\n')                  // output non-lineend character
+        line[ptr++] = ch;
+    }
+  }
+  else while(len--) line[ptr++] = CDC_read();       // keep everything
+  return ptr;
+}
+
+// USB OUT task: data from the host, one USB packet, line or raw payload per run
+// (command lines are left for the command task)
+void TASK_usbOut(void) {
+  #if FEATURE_TX && FEATURE_TEXT
+  uint8_t blk;
+  #endif
+  #if FEATURE_BINARY || (FEATURE_TX && FEATURE_TEXT)
+  uint8_t len;
+  #endif
+
+  #if FEATURE_RAW
+  if(options & RAW_MODE) {                          // raw stream mode?
+    if(RAW_direct()) {                              // full payload in USB buffer?
+      if(TXQ_sendDirect(CDC_peek(), NRF_PAYLOAD))   // -> send it from there when
+        CDC_skip(NRF_PAYLOAD);                      //    the radio is idle
+    }
+    else if(CDC_available() && (RAW_len < NRF_PAYLOAD)) { // otherwise collect:
+      __xdata uint8_t *ptr;
+      if(!RAW_len) RAW_blk = POOL_alloc();          // take block for next packet
+      ptr = POOL_data(RAW_blk);
+      do {
+        ptr[RAW_len++] = CDC_read();                // read byte into raw block
+      } while(CDC_available() && (RAW_len < NRF_PAYLOAD));
+      TMR_start(TMR_RAW, RAW_TIMEOUT);              // restart idle timeout
+    }
+    if(RAW_len && (TXQ_count < TX_QUEUE_SIZE)       // send raw block if full or idle
+       && ((RAW_len == NRF_PAYLOAD) || !TMR_running(TMR_RAW))) {
+      TXQ_submit(RAW_blk, TXQ_REPORT_NONE, 0, 0, RAW_len); // hand block to queue
+      RAW_len = 0;
     }
+    return;
+  }
+  #endif
+
+  #if FEATURE_BINARY
+  if(options & BINARY_MODE) {                       // binary frames coming in via USB?
+    while(CDC_available() && (TXQ_count < TX_QUEUE_SIZE)) { // queue full -> leave
+      len = FRAME_receive(CDC_read());              // feed byte into frame decoder
+      if(len) processFrame(len);                    // process completed frame
+    }                                               // the rest for later
+    return;
+  }
+  #endif
+
+  #if FEATURE_TX && FEATURE_TEXT
+  blk = TXQ_alloc();                                // read straight into a packet
+  len = readLine(POOL_data(blk), options & HEX_MODE); // block for the TX queue
+  if(len) TXQ_submit(blk, TXQ_REPORT_TEXT, 0, 0, len);  // -> hand the block over
+  else POOL_free(blk);                              // nothing left (line-end only)
+  #else
+  readLine(buffer, 0);                              // receive only: discard data
+  #endif
+}
+
+// USB IN task: send event notification
+void TASK_usbIn(void) {
+  EVT_service();
+}
+
+// Command task: read command line from USB and parse it
+void TASK_command(void) {
+  uint8_t len;
+  if(!CDC_available()) return;
+  len = readLine(buffer, 0);
+  if(len == NRF_PAYLOAD) len--;                     // room for terminating zero
+  buffer[len] = '\0';
+  parse();
+}
+
+// Housekeeping task (runs when no other task is ready): break, suspend, LED
+void TASK_housekeeping(void) {
+  if(CDC_getBREAK()) {                              // host sent a break?
+    CDC_clearBREAK();
+    options &= ~(RAW_MODE | BINARY_MODE);           // -> return to text mode
+    #if FEATURE_RAW
+    if(RAW_len) POOL_free(RAW_blk);                 // discard raw input
+    RAW_len = 0;
+    #endif
+    FLASH_markDirty();                              // save settings later
+    CDC_printSettings();                            // print settings via CDC
+  }
+
+  if(CDC_getSUSPEND() && !TXQ_count) {              // bus suspended, queue empty?
+    CDC_clearSUSPEND();
+    FLASH_commit();                                 // save changed settings
+    SUSP_handle();                                  // sleep until resumed
+  }
 
-    PIN_high(PIN_LED);                              // switch off LED
+  if(TMR_expired(TMR_FLASH)) FLASH_commit();        // save settings after idle time
+
+  PIN_high(PIN_LED);                                // switch off LED
+}
+
+// Tasks in order of priority (see config.h)
+__code task_t TASK_table[TASKS] = {
+  TASK_radio, TASK_usbOut, TASK_usbIn, TASK_command, TASK_housekeeping
+};
+
+// Post the tasks that have work to do
+void TASK_poll(void) {
+  uint8_t cmd;
+  if(NRF_irqFlag || (TXQ_count && !TXQ_busy && NRF_ready()))
+    TASK_post(TASK_RADIO);
+
+  #if FEATURE_RAW
+  if(options & RAW_MODE) {                          // raw: data to collect or to send?
+    if(RAW_direct()) {                              // full payload in USB buffer:
+      if(TXQ_directReady()) TASK_post(TASK_USB_OUT);// -> only when it can be sent
+    }
+    else if((CDC_available() && (RAW_len < NRF_PAYLOAD))
+       || (RAW_len && (TXQ_count < TX_QUEUE_SIZE)
+           && ((RAW_len == NRF_PAYLOAD) || !TMR_running(TMR_RAW))))
+      TASK_post(TASK_USB_OUT);
+  }
+  else
+  #endif
+  if(CDC_available()) {                             // data from the host:
+    cmd = (*CDC_peek() == CMD_IDENT);               // command line?
+    #if FEATURE_BINARY
+    if(options & BINARY_MODE) cmd = 0;              // (binary: commands are frames)
+    #endif
+    if(cmd) TASK_post(TASK_COMMAND);
+    #if FEATURE_TX
+    else if(TXQ_count < TX_QUEUE_SIZE) TASK_post(TASK_USB_OUT); // needs free TX slot
+    #else
+    else TASK_post(TASK_USB_OUT);
+    #endif
+  }
+
+  if((EVT_state() != EVT_sent) && CDC_notifyReady()) TASK_post(TASK_USB_IN);
+
+  TASK_post(TASK_HOUSEKEEPING);                     // runs when nothing else is ready
+}
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+void main(void) {
+  // Setup
+  CLK_config();                                     // configure system clock
+  TMR_init();                                       // start millisecond timer
+  while(!TMR_timeout(0, 5));                        // wait for clock to settle
+  FLASH_readSettings();                             // read user settings from flash
+  #if POOL_BLOCKS
+  POOL_init();                                      // put packet blocks into pool
+  #endif
+  TASK_clearStats();                                // start task statistics
+  CDC_init();                                       // init USB CDC
+  NRF_init();                                       // init nRF24L01+
+  WDT_start();                                      // start watchdog timer
+
+  // Loop
+  while(1) {
+    TASK_poll();                                    // post tasks with work to do
+    TASK_run();                                     // run the most urgent one
     WDT_reset();                                    // reset watchdog
   }
 }
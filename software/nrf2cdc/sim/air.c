@@ -0,0 +1,517 @@
+// ===================================================================================
+// Virtual RF Medium for Multi-Node Simulation of NRF2CDC                     * v1.0 *
+// ===================================================================================
+//
+// Connects several simulated devices (nrf2cdc_sim, each running the unmodified
+// firmware with its own scenario) through a shared virtual air and keeps them in
+// lockstep, one simulated millisecond per round (protocol: see air.h). Modeled:
+//
+// - channel, data rate and address: a packet reaches every other node, whose radio
+//   takes it if it listens on the same channel and data rate with a matching pipe
+// - air time: preamble, 5-byte address, packet control field, payload and 2-byte CRC
+//   at the data rate, 130us settling before the first attempt
+// - collisions: a transmission starts at a random point of the millisecond its
+//   device started it; transmissions overlapping on a channel destroy each other
+// - loss: each packet is lost with the given probability per receiver, each ACK too
+// - latency: added to the arrival of every packet and ACK
+// - auto-ACK: the receiver answers 130us after the packet; the ACK counts if it
+//   arrives within the retransmit delay (SETUP_RETR), otherwise the sender tries
+//   again up to the retransmit count; a receiver takes a repeated packet only once
+//
+// Outcomes go back to the senders when their last attempt is over, packets to the
+// receivers when they arrive, both with 1 ms resolution. ACK packets don't occupy
+// the air (they don't collide) and there is no capture effect. Random numbers come
+// from a seeded generator, so every run with the same arguments gives the same
+// result.
+//
+// Usage:   nrf2cdc_air [-l loss] [-d us] [-s seed] [-t ms] [-v] scenario...
+//          -l loss         packet and ACK loss in percent (default 0)
+//          -d us           latency of packets and ACKs in microseconds (default 0)
+//          -s seed         random seed (default 1)
+//          -t ms           end after this many simulated ms (default: when all nodes
+//                          ended their scenario)
+//          -v              trace every transmission attempt
+//          scenario...     one scenario file per node (see sim.c), numbered from 1
+//
+// The medium starts nrf2cdc_sim from its own directory. The trace of every node is
+// printed with the node number in front. At the end the medium prints per node the
+// packets sent, transmission attempts, acknowledged and failed (MAX_RT) packets,
+// collisions, losses, packets received from the others, the throughput (payload
+// bytes that reached a receiver per simulated second) and the latency (from the
+// start of the millisecond the radio got the packet to its first arrival).
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "nrf24_sim.h"
+#include "air.h"
+
+#define AIR_MAX_NODES       16
+#define AIR_SETTLE          130                 // TX/RX settling time in us
+
+// Next event of a transmission
+#define EV_NONE             0
+#define EV_START            1                   // attempt goes on the air
+#define EV_END              2                   // attempt is off the air
+#define EV_ARRIVE           3                   // attempt arrives at the receivers
+#define EV_DONE             4                   // outcome is known to the sender
+
+typedef struct {
+  pid_t     pid;
+  int       fd;                                 // socket, -1: node ended
+  int       out;                                // trace pipe, -1: closed
+  char      text[65536];                        // trace not printed yet
+  size_t    textLen;
+
+  air_msg_t tx;                                 // current transmission
+  uint8_t   event;                              // its next event
+  uint32_t  time;                               // time of the event in us
+  uint32_t  begin;                              // radio got the packet
+  uint32_t  onAir, offAir;                      // current attempt on the air
+  uint8_t   collided, attempts, acked, delivered;
+  uint8_t   took[AIR_MAX_NODES];                // receivers: 1: took it, 2: and ACKed
+
+  uint32_t  packets, tries, ackedCount, failed, collisions, losses, received;
+  uint32_t  bytes, latencyMax, latencyCount;
+  uint64_t  latencySum;
+} air_node_t;
+
+static air_node_t AIR_node[AIR_MAX_NODES];
+static uint8_t    AIR_nodes;
+static uint32_t   AIR_time;                     // simulated ms
+static uint32_t   AIR_seed = 1;                 // random generator state
+static uint32_t   AIR_seedArg = 1;              // -s
+static uint32_t   AIR_loss;                     // in 1/100 percent
+static uint32_t   AIR_latency;                  // us
+static uint8_t    AIR_verbose;
+static uint64_t   AIR_busy[128];                // air time per channel in us
+
+// ===================================================================================
+// Helpers
+// ===================================================================================
+
+// Seeded pseudo random number in 0..range-1 (xorshift32)
+static uint32_t AIR_random(uint32_t range) {
+  AIR_seed ^= AIR_seed << 13;
+  AIR_seed ^= AIR_seed >> 17;
+  AIR_seed ^= AIR_seed << 5;
+  return AIR_seed % range;
+}
+
+// Packet or ACK lost on the way?
+static uint8_t AIR_lost(void) {
+  return AIR_loss && (AIR_random(10000) < AIR_loss);
+}
+
+// Air time of a packet in us
+static uint32_t AIR_airtime(uint8_t rate, uint8_t len) {
+  static const uint32_t KBPS[] = {250, 1000, 2000};
+  uint32_t bits = 8 * (1 + 5 + len + 2) + 9;    // preamble, address, payload, CRC, PCF
+  return (bits * 1000 + KBPS[rate] - 1) / KBPS[rate];
+}
+
+// Retransmit delay and count from SETUP_RETR
+static uint32_t AIR_ard(const air_node_t *n) {
+  return ((n->tx.retr >> 4) + 1) * 250;
+}
+
+static uint8_t AIR_arc(const air_node_t *n) {
+  return n->tx.retr & 0x0F;
+}
+
+// Medium trace line
+static void AIR_trace(uint32_t us, const char *fmt, ...) {
+  va_list ap;
+  if(!AIR_verbose) return;
+  printf("air %7lu.%03u  ", (unsigned long)(us / 1000), (unsigned)(us % 1000));
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  putchar('\n');
+}
+
+// ===================================================================================
+// Node Processes
+// ===================================================================================
+
+// Print complete trace lines of a node with its number in front
+static void AIR_flush(air_node_t *n, uint8_t all) {
+  char *line = n->text, *nl;
+  size_t left = n->textLen;
+  while((nl = memchr(line, '\n', left)) || (all && left)) {
+    size_t len = nl ? (size_t)(nl - line) + 1 : left;
+    printf("%-3u ", (unsigned)(n - AIR_node) + 1);
+    fwrite(line, 1, len, stdout);
+    if(!nl) putchar('\n');
+    line += len;
+    left -= len;
+  }
+  memmove(n->text, line, left);
+  n->textLen = left;
+}
+
+// Take trace output of a node from its pipe
+static void AIR_read(air_node_t *n) {
+  ssize_t len;
+  if(n->textLen == sizeof(n->text)) AIR_flush(n, 1);
+  len = read(n->out, n->text + n->textLen, sizeof(n->text) - n->textLen);
+  if(len > 0) n->textLen += len;
+  else if(!len || (errno != EINTR)) {
+    close(n->out);
+    n->out = -1;
+  }
+}
+
+// Node has ended (or crashed): drop its socket and pending transmission
+static void AIR_drop(air_node_t *n) {
+  if(n->fd < 0) return;
+  close(n->fd);
+  n->fd    = -1;
+  n->event = EV_NONE;
+}
+
+// Send message to a node, 0 if the node has ended
+static uint8_t AIR_put(air_node_t *n, const air_msg_t *msg) {
+  if(n->fd < 0) return 0;
+  while(send(n->fd, msg, sizeof(air_msg_t), 0) != sizeof(air_msg_t)) {
+    if(errno == EINTR) continue;
+    AIR_drop(n);
+    return 0;
+  }
+  return 1;
+}
+
+// Wait for message of a node while taking the trace output of all nodes,
+// 0 if the node has ended
+static uint8_t AIR_get(air_node_t *n, air_msg_t *msg) {
+  struct pollfd fds[AIR_MAX_NODES + 1];
+  air_node_t *src[AIR_MAX_NODES + 1];
+  int count, i;
+  ssize_t len;
+  while(n->fd >= 0) {
+    fds[0].fd = n->fd;
+    fds[0].events = POLLIN;
+    src[0] = n;
+    count = 1;
+    for(i = 0; i < AIR_nodes; i++) {
+      if(AIR_node[i].out < 0) continue;
+      fds[count].fd = AIR_node[i].out;
+      fds[count].events = POLLIN;
+      src[count++] = &AIR_node[i];
+    }
+    if(poll(fds, count, -1) < 0) {
+      if(errno == EINTR) continue;
+      perror("poll");
+      exit(1);
+    }
+    for(i = 1; i < count; i++)
+      if(fds[i].revents) AIR_read(src[i]);
+    if(!fds[0].revents) continue;
+    len = recv(n->fd, msg, sizeof(air_msg_t), 0);
+    if(len == sizeof(air_msg_t)) return 1;
+    if((len < 0) && (errno == EINTR)) continue;
+    AIR_drop(n);
+  }
+  return 0;
+}
+
+// Start the simulation of a node
+static void AIR_start(air_node_t *n, const char *sim, const char *scenario) {
+  int sv[2], pv[2], i;
+  char fd[16];
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) || pipe(pv)) {
+    perror("socketpair");
+    exit(1);
+  }
+  fflush(stdout);
+  n->pid = fork();
+  if(n->pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if(!n->pid) {                                 // child: the node's simulation
+    for(i = 0; i < n - AIR_node; i++) {         // the other nodes' ends stay closed
+      close(AIR_node[i].fd);
+      close(AIR_node[i].out);
+    }
+    close(sv[0]);
+    close(pv[0]);
+    dup2(pv[1], STDOUT_FILENO);
+    close(pv[1]);
+    sprintf(fd, "%d", sv[1]);
+    execl(sim, sim, "-a", fd, scenario, (char *)NULL);
+    perror(sim);
+    _exit(1);
+  }
+  close(sv[1]);
+  close(pv[1]);
+  n->fd  = sv[0];
+  n->out = pv[0];
+}
+
+// ===================================================================================
+// Transmissions
+// ===================================================================================
+
+// Node starts a transmission in the current millisecond
+static void AIR_transmit(air_node_t *n, const air_msg_t *msg) {
+  n->tx        = *msg;
+  n->event     = EV_START;
+  n->begin     = AIR_time * 1000;
+  n->time      = n->begin + AIR_random(1000) + AIR_SETTLE;
+  n->attempts  = n->acked = n->delivered = 0;
+  memset(n->took, 0, sizeof(n->took));
+  n->packets++;
+}
+
+// Attempt goes on the air: check for collisions
+static void AIR_onAir(air_node_t *n) {
+  uint8_t i;
+  air_node_t *o;
+  n->attempts++;
+  n->tries++;
+  n->collided = 0;
+  n->onAir    = n->time;
+  n->offAir   = n->time + AIR_airtime(n->tx.rate, n->tx.len);
+  AIR_busy[n->tx.ch & 0x7F] += n->offAir - n->onAir;
+  for(i = 0; i < AIR_nodes; i++) {
+    o = &AIR_node[i];
+    if((o == n) || (o->event != EV_END) || (o->offAir <= n->time)) continue;
+    if(o->tx.ch != n->tx.ch) continue;
+    o->collided = n->collided = 1;               // o is on the air right now
+  }
+  n->event = EV_END;
+  n->time  = n->offAir;
+}
+
+// Attempt is over without ACK: try again or give up
+static void AIR_retry(air_node_t *n, uint32_t now) {
+  n->time = n->offAir + AIR_ard(n);
+  if(n->time < now) n->time = now;
+  n->event = (n->attempts <= AIR_arc(n)) ? EV_START : EV_DONE;
+}
+
+// Attempt is off the air
+static void AIR_offAir(air_node_t *n) {
+  if(n->collided) {
+    n->collisions++;
+    AIR_trace(n->time, "%u ch %02X attempt %u: collision", (unsigned)(n - AIR_node) + 1,
+              n->tx.ch, n->attempts);
+    if(n->tx.noack) n->event = EV_DONE;
+    else AIR_retry(n, n->time);
+    return;
+  }
+  n->event = EV_ARRIVE;
+  n->time += AIR_latency;
+}
+
+// Attempt arrives at the other nodes
+static void AIR_arrive(air_node_t *n) {
+  char info[256];
+  char *ptr = info;
+  air_msg_t msg;
+  uint8_t i, ack = 0;
+  uint32_t ackTime, latency;
+  air_node_t *r;
+  *ptr = 0;
+
+  for(i = 0; i < AIR_nodes; i++) {
+    r = &AIR_node[i];
+    if((r == n) || (r->fd < 0)) continue;
+    if(AIR_lost()) {
+      n->losses++;
+      ptr += sprintf(ptr, ", %u lost", i + 1);
+      continue;
+    }
+    if(!n->took[i]) {                           // new packet for this receiver
+      msg = n->tx;
+      msg.type = AIR_PACKET;
+      if(!AIR_put(r, &msg)) continue;
+      do if(!AIR_get(r, &msg)) break; while(msg.type != AIR_RECEIVED);
+      if(r->fd < 0) continue;
+      if(msg.result == RFM_RX_OK)  n->took[i] = 1;
+      if(msg.result == RFM_RX_ACK) n->took[i] = 2;
+      if(!n->took[i]) continue;                 // ignored or RX FIFO full
+      r->received++;
+      ptr += sprintf(ptr, ", %u took it", i + 1);
+      if(!n->delivered) {
+        n->delivered = 1;
+        n->bytes += n->tx.len;
+        latency = n->time - n->begin;
+        n->latencySum += latency;
+        n->latencyCount++;
+        if(latency > n->latencyMax) n->latencyMax = latency;
+      }
+    }
+    else ptr += sprintf(ptr, ", %u repeated", i + 1);
+    if(n->took[i] == 2) ack = 1;
+  }
+
+  if(n->tx.noack) {
+    AIR_trace(n->time, "%u ch %02X no-ack%s", (unsigned)(n - AIR_node) + 1, n->tx.ch,
+              info);
+    n->event = EV_DONE;
+    return;
+  }
+  ackTime = n->time + AIR_SETTLE + AIR_airtime(n->tx.rate, 0) + AIR_latency;
+  if(ack && AIR_lost()) ack = 0, ptr += sprintf(ptr, ", ACK lost");
+  else if(ack && (ackTime > n->offAir + AIR_ard(n)))
+    ack = 0, ptr += sprintf(ptr, ", ACK late");
+  AIR_trace(n->time, "%u ch %02X attempt %u%s%s", (unsigned)(n - AIR_node) + 1,
+            n->tx.ch, n->attempts, info, ack ? ", ACK" : "");
+  if(ack) {
+    n->acked = 1;
+    n->event = EV_DONE;
+    n->time  = ackTime;
+  }
+  else AIR_retry(n, n->time);
+}
+
+// Sender learns the outcome
+static void AIR_done(air_node_t *n) {
+  air_msg_t msg;
+  n->event = EV_NONE;
+  if(!n->tx.noack) {
+    if(n->acked) n->ackedCount++;
+    else n->failed++;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.type   = AIR_RESULT;
+  msg.result = n->acked;
+  msg.retr   = n->attempts - 1;
+  AIR_put(n, &msg);
+}
+
+// Run all events up to the end of the current millisecond in time order
+static void AIR_events(void) {
+  uint32_t end = AIR_time * 1000 + 1000;
+  air_node_t *n, *next;
+  uint8_t i;
+  for(;;) {
+    next = NULL;
+    for(i = 0; i < AIR_nodes; i++) {
+      n = &AIR_node[i];
+      if((n->fd < 0) || (n->event == EV_NONE) || (n->time >= end)) continue;
+      if(!next || (n->time < next->time)) next = n;
+    }
+    if(!next) return;
+    switch(next->event) {
+      case EV_START:  AIR_onAir(next);  break;
+      case EV_END:    AIR_offAir(next); break;
+      case EV_ARRIVE: AIR_arrive(next); break;
+      case EV_DONE:   AIR_done(next);   break;
+    }
+  }
+}
+
+// ===================================================================================
+// Statistics
+// ===================================================================================
+
+static void AIR_stats(void) {
+  air_node_t *n;
+  uint8_t i;
+  double secs = AIR_time ? AIR_time / 1000.0 : 1.0;
+  printf("air: %lu ms, %u nodes, loss %.2f%%, latency %lu us, seed %lu\n",
+         (unsigned long)AIR_time, AIR_nodes, AIR_loss / 100.0,
+         (unsigned long)AIR_latency, (unsigned long)AIR_seedArg);
+  printf("node  packets  attempts  acked  failed  collisions  lost  received"
+         "  throughput  latency avg/max\n");
+  for(i = 0; i < AIR_nodes; i++) {
+    n = &AIR_node[i];
+    printf("%4u  %7lu  %8lu  %5lu  %6lu  %10lu  %4lu  %8lu  %6.0f B/s  ", i + 1,
+           (unsigned long)n->packets, (unsigned long)n->tries,
+           (unsigned long)n->ackedCount, (unsigned long)n->failed,
+           (unsigned long)n->collisions, (unsigned long)n->losses,
+           (unsigned long)n->received, n->bytes / secs);
+    if(n->latencyCount)
+      printf("%5lu/%lu us\n", (unsigned long)(n->latencySum / n->latencyCount),
+             (unsigned long)n->latencyMax);
+    else printf("    -\n");
+  }
+  for(i = 0; i < 128; i++)
+    if(AIR_busy[i])
+      printf("channel %02X: %.1f%% busy\n", i, AIR_busy[i] / (secs * 10000.0));
+}
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+int main(int argc, char **argv) {
+  char sim[4096];
+  const char *slash;
+  air_msg_t msg;
+  air_node_t *n;
+  uint32_t limit = 0;
+  uint8_t alive;
+  int opt, i;
+
+  while((opt = getopt(argc, argv, "l:d:s:t:v")) != -1) {
+    switch(opt) {
+      case 'l': AIR_loss    = atof(optarg) * 100 + 0.5; break;
+      case 'd': AIR_latency = atol(optarg); break;
+      case 's': AIR_seed    = strtoul(optarg, NULL, 0); break;
+      case 't': limit       = atol(optarg); break;
+      case 'v': AIR_verbose = 1; break;
+      default:  optind = argc + 1; break;
+    }
+  }
+  if((optind >= argc) || (argc - optind > AIR_MAX_NODES)) {
+    fprintf(stderr, "usage: %s [-l loss] [-d us] [-s seed] [-t ms] [-v] scenario...\n"
+                    "       (up to %u scenarios, one per node)\n", argv[0], AIR_MAX_NODES);
+    return 1;
+  }
+  if(!AIR_seed) AIR_seed = 1;
+  AIR_seedArg = AIR_seed;
+
+  // Start nodes (nrf2cdc_sim next to this program)
+  slash = strrchr(argv[0], '/');
+  snprintf(sim, sizeof(sim), "%.*snrf2cdc_sim", slash ? (int)(slash - argv[0]) + 1 : 0,
+           argv[0]);
+  signal(SIGPIPE, SIG_IGN);
+  for(i = optind; i < argc; i++) AIR_start(&AIR_node[AIR_nodes++], sim, argv[i]);
+
+  // Rounds of one millisecond
+  for(;;) {
+    alive = 0;
+    for(i = 0; i < AIR_nodes; i++) {            // wait until all nodes are idle
+      n = &AIR_node[i];
+      while(AIR_get(n, &msg) && (msg.type != AIR_DONE));
+      if(n->fd >= 0) alive++;
+    }
+    for(i = 0; i < AIR_nodes; i++) AIR_flush(&AIR_node[i], 0);
+    if(!alive || (limit && (AIR_time >= limit))) break;
+
+    AIR_time++;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = AIR_TICK;
+    for(i = 0; i < AIR_nodes; i++) AIR_put(&AIR_node[i], &msg);
+    for(i = 0; i < AIR_nodes; i++) {            // transmissions of this millisecond
+      n = &AIR_node[i];
+      while(AIR_get(n, &msg) && (msg.type != AIR_SENT))
+        if(msg.type == AIR_TX) AIR_transmit(n, &msg);
+    }
+    AIR_events();
+    memset(&msg, 0, sizeof(msg));
+    msg.type = AIR_END;
+    for(i = 0; i < AIR_nodes; i++) AIR_put(&AIR_node[i], &msg);
+  }
+
+  // End the remaining nodes (they print their counters) and collect the last output
+  for(i = 0; i < AIR_nodes; i++) AIR_drop(&AIR_node[i]);
+  for(i = 0; i < AIR_nodes; i++) {
+    n = &AIR_node[i];
+    while(n->out >= 0) AIR_read(n);
+    AIR_flush(n, 1);
+    waitpid(n->pid, NULL, 0);
+  }
+  AIR_stats();
+  return 0;
+}
@@ -0,0 +1,42 @@
+// ===================================================================================
+// Messages between the Virtual RF Medium and the Simulated Devices           * v1.0 *
+// ===================================================================================
+//
+// The medium (air.c) runs every device simulation (sim.c -a fd) as a child process
+// connected by a SOCK_SEQPACKET socket pair and keeps all of them in lockstep, one
+// simulated millisecond per round:
+//
+//   device                          medium
+//   AIR_DONE     ------------->                  foreground idle, ready for a tick
+//                <-------------     AIR_TICK     advance 1 ms
+//   AIR_TX       ------------->                  radio starts a transmission
+//   AIR_SENT     ------------->                  transmissions of this tick done
+//                <-------------     AIR_PACKET   packet for the radio (any number)
+//   AIR_RECEIVED ------------->                  RFM_receive() result
+//                <-------------     AIR_RESULT   outcome of the device's transmission
+//                <-------------     AIR_END      end of tick
+
+#pragma once
+#include <stdint.h>
+
+// Message types
+#define AIR_DONE        1
+#define AIR_TICK        2
+#define AIR_TX          3
+#define AIR_SENT        4
+#define AIR_PACKET      5
+#define AIR_RECEIVED    6
+#define AIR_RESULT      7
+#define AIR_END         8
+
+typedef struct {
+  uint8_t  type;                      // message type
+  uint8_t  ch;                        // TX/PACKET: RF channel
+  uint8_t  rate;                      // TX/PACKET: 0: 250kbps, 1: 1Mbps, 2: 2Mbps
+  uint8_t  noack;                     // TX/PACKET: no ACK requested
+  uint8_t  retr;                      // TX: SETUP_RETR, RESULT: retransmits
+  uint8_t  result;                    // RECEIVED: RFM_RX_x, RESULT: acknowledged
+  uint8_t  addr[5];                   // TX/PACKET: address (LSB first)
+  uint8_t  len;                       // TX/PACKET: payload length
+  uint8_t  data[32];                  // TX/PACKET: payload
+} air_msg_t;
@@ -0,0 +1,500 @@
+// ===================================================================================
+// Cycle Benchmark of the NRF2CDC Firmware Image                              * v1.0 *
+// ===================================================================================
+//
+// Loads the firmware as built by SDCC (nrf2cdc.ihx) into the cycle-counting 8051
+// core (mcs51.c) with CH552 peripheral models: SPI with the nRF24L01+ model
+// (nrf24_sim.c), USB device with a scripted host, data flash, timer2 and the GPIO
+// interrupt of the NRF IRQ pin. A fixed sequence of operations is run and the clock
+// cycles each one costs are reported:
+//
+// fg       cycles of the main loop iterations that did more than idle polling
+// isr      cycles in the USB and GPIO interrupt service routines
+// total    fg + isr
+// loops    number of those main loop iterations
+// SPI      bytes exchanged with the NRF
+// USB      packets transferred (all endpoints)
+// latency  time from the event (data from the host, packet on the air) to the end
+//          of the last busy main loop iteration
+//
+// The timer2 interrupt runs every millisecond regardless of the operations, so it
+// is reported once, together with the length of an idle main loop iteration (one
+// WDT_reset() per iteration).
+//
+// Usage:   nrf2cdc_bench [-v] [firmware.ihx]
+//          -v              trace USB and radio traffic
+//
+// 'make bench' builds the firmware and the harness and runs it. Cycle counts follow
+// the approximated instruction timing of mcs51.c, so compare figures of the same
+// harness before and after a change rather than with the datasheet.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcs51.h"
+#include "nrf24_sim.h"
+
+// Register addresses and bits from the CH55x header: every SFR and SBIT becomes a
+// type whose size is its address + 1
+#define __sfr           typedef
+#define __sfr16         typedef
+#define __sfr32         typedef
+#define __sbit          typedef
+#define __at(x)         struct { uint8_t a[(x) + 1]; }
+#define __xdata
+#define __pdata
+#include "../src/ch554.h"
+#include "../src/config.h"
+
+#define ADDR(name)      ((uint8_t)(sizeof(name) - 1))       // SFR or bit address
+#define BIT(name)       (1 << (ADDR(name) & 7))             // mask of SBIT in its SFR
+#define REG(name)       MCS_SFR(ADDR(name))                 // SFR storage
+
+// Pin numbering as in gpio.h
+enum{P10, P11, P12, P13, P14, P15, P16, P17, P30, P31, P32, P33, P34, P35, P36, P37};
+#define PIN_MASK(pin)   (1 << ((pin) & 7))
+#define PIN_PORT(pin)   (((pin) < P30) ? ADDR(P1) : ADDR(P3))
+
+// Harness parameters
+#define BENCH_MS        (F_CPU / 1000)      // clock cycles per millisecond
+#define BENCH_USB_POLL  64                  // clock cycles between USB host polls
+#define BENCH_ADDR      "\xC2\xC2\xC2\xC2\xC2" // RX address of the device (default)
+
+// Peripheral state
+static uint8_t  BENCH_verbose;              // trace traffic
+static uint8_t  BENCH_flash[128];           // data flash
+static uint32_t BENCH_flashWrites;          // data flash write commands
+static uint32_t BENCH_spiBytes;             // bytes exchanged via SPI
+static uint32_t BENCH_spiDone;              // cycle when SPI transfer is finished
+static uint8_t  BENCH_spiData;              // byte received via SPI
+static uint8_t  BENCH_irqLast = 1;          // last level of NRF IRQ pin
+static uint8_t  BENCH_gpioFlag;             // GPIO interrupt flag
+static uint8_t  BENCH_t2Clock;              // timer2 prescaler
+static uint32_t BENCH_nextPoll;             // cycle of next USB host poll
+static uint32_t BENCH_nextTick;             // cycle of next millisecond tick
+
+// USB host
+static uint8_t  BENCH_host[256];            // data to send to the device
+static uint16_t BENCH_hostLen;
+static uint8_t  BENCH_setup[8];             // SETUP packet to send to EP0
+static uint8_t  BENCH_setupPending;         // SETUP packet waiting
+static uint8_t  BENCH_statusPending;        // status stage of control transfer waiting
+static uint32_t BENCH_usbPackets;           // packets transferred
+static uint32_t BENCH_hostBytes;            // bytes received by the host via EP2
+
+// Accounting
+static uint32_t BENCH_isr[14];              // cycles per interrupt number
+static uint32_t BENCH_isrTotal;             // cycles in all interrupts
+static uint32_t BENCH_loopStart;            // cycle count at start of loop iteration
+static uint32_t BENCH_loopIsr;              // interrupt cycles at start of iteration
+static uint32_t BENCH_idleLen;              // max cycles of an idle iteration (0: unknown)
+static uint32_t BENCH_idleMax;              // longest iteration while learning
+static uint32_t BENCH_loops;                // all main loop iterations
+static uint32_t BENCH_busy;                 // cycles of busy iterations
+static uint32_t BENCH_busyLoops;            // number of busy iterations
+static uint32_t BENCH_lastBusy;             // cycle count at end of last busy iteration
+
+// ===================================================================================
+// Trace
+// ===================================================================================
+
+static void BENCH_trace(const char *tag, const uint8_t *buf, uint16_t len) {
+  if(!BENCH_verbose) return;
+  printf("%9lu  %-6s \"", (unsigned long)MCS_cycles, tag);
+  while(len--) {
+    uint8_t c = *buf++;
+    if     (c == '\n') printf("\\n");
+    else if(c == '\r') printf("\\r");
+    else if((c < 0x20) || (c > 0x7E) || (c == '\\')) printf("\\x%02X", c);
+    else putchar(c);
+  }
+  printf("\"\n");
+}
+
+// ===================================================================================
+// NRF, SPI and Pins
+// ===================================================================================
+
+// Check NRF IRQ pin for the GPIO interrupt
+static void BENCH_checkIRQ(void) {
+  uint8_t irq = RFM_irq();
+  if(REG(GPIO_IE) & bIE_P3_1_LO) {
+    if(REG(GPIO_IE) & bIE_IO_EDGE) {
+      if(BENCH_irqLast && !irq) BENCH_gpioFlag = 1;         // falling edge
+    }
+    else if(!irq) BENCH_gpioFlag = 1;                       // low level
+  }
+  BENCH_irqLast = irq;
+}
+
+// Device transmits a packet; the peer always acknowledges
+uint8_t RFM_transmit(uint8_t ch, uint8_t rate, const uint8_t *addr,
+                     const uint8_t *buf, uint8_t len, uint8_t noack) {
+  (void)ch; (void)rate; (void)addr; (void)noack;
+  BENCH_trace("rf>", buf, len);
+  return 1;
+}
+
+// Peer transmits a packet to the device
+static void BENCH_air(const char *buf, uint8_t len) {
+  BENCH_trace("rf<", (const uint8_t *)buf, len);
+  RFM_receive(RFM_channel(), RFM_rate(), (const uint8_t *)BENCH_ADDR,
+              (const uint8_t *)buf, len, 0);
+  BENCH_checkIRQ();
+}
+
+// ===================================================================================
+// USB Host
+// ===================================================================================
+
+// Complete a transfer and raise the USB interrupt flag
+static void BENCH_transfer(uint8_t token, uint8_t len) {
+  REG(USB_INT_ST)  = token | bUIS_TOG_OK;
+  REG(USB_RX_LEN)  = len;
+  REG(USB_INT_FG) |= BIT(UIF_TRANSFER) | BIT(U_TOG_OK);
+  BENCH_usbPackets++;
+}
+
+// Poll the endpoints like the host does (one transfer at a time)
+static void BENCH_usbService(void) {
+  uint16_t ep0 = REG(UEP0_DMA_L) | (REG(UEP0_DMA_H) << 8);
+  uint16_t ep2 = REG(UEP2_DMA_L) | (REG(UEP2_DMA_H) << 8);
+  uint8_t  len;
+  if(!(REG(USB_CTRL) & bUC_DEV_PU_EN)) return;              // device not enabled
+  if(REG(USB_INT_FG) & BIT(UIF_TRANSFER)) return;           // last transfer not handled
+
+  // EP0: SETUP and status stage of control transfers
+  if(BENCH_setupPending) {
+    memcpy(MCS_xdata + ep0, BENCH_setup, 8);
+    BENCH_setupPending  = 0;
+    BENCH_statusPending = 1;
+    BENCH_transfer(UIS_TOKEN_SETUP | 0, 8);
+  }
+  else if(BENCH_statusPending && ((REG(UEP0_CTRL) & MASK_UEP_T_RES) == UEP_T_RES_ACK)) {
+    BENCH_statusPending = 0;
+    BENCH_transfer(UIS_TOKEN_IN | 0, 0);
+  }
+
+  // EP2 IN: bulk data to host
+  else if((REG(UEP2_CTRL) & MASK_UEP_T_RES) == UEP_T_RES_ACK) {
+    BENCH_trace("host<", MCS_xdata + ep2 + 64, REG(UEP2_T_LEN));
+    BENCH_hostBytes += REG(UEP2_T_LEN);
+    BENCH_transfer(UIS_TOKEN_IN | 2, 0);
+  }
+
+  // EP1 IN: SERIAL_STATE notification
+  else if((REG(UEP1_CTRL) & MASK_UEP_T_RES) == UEP_T_RES_ACK)
+    BENCH_transfer(UIS_TOKEN_IN | 1, 0);
+
+  // EP2 OUT: bulk data from host
+  else if(BENCH_hostLen && ((REG(UEP2_CTRL) & MASK_UEP_R_RES) == UEP_R_RES_ACK)) {
+    len = (BENCH_hostLen > 64) ? 64 : BENCH_hostLen;
+    memcpy(MCS_xdata + ep2, BENCH_host, len);
+    memmove(BENCH_host, BENCH_host + len, BENCH_hostLen - len);
+    BENCH_hostLen -= len;
+    BENCH_transfer(UIS_TOKEN_OUT | 2, len);
+  }
+}
+
+// Host sends data via EP2
+static void BENCH_send(const char *buf, uint16_t len) {
+  BENCH_trace("host>", (const uint8_t *)buf, len);
+  if(BENCH_hostLen + len > sizeof(BENCH_host)) len = sizeof(BENCH_host) - BENCH_hostLen;
+  memcpy(BENCH_host + BENCH_hostLen, buf, len);
+  BENCH_hostLen += len;
+}
+
+// Host sends a data frame (binary mode): header + payload, COBS encoded
+static void BENCH_sendFrame(uint8_t header, const char *buf, uint8_t len) {
+  char    frame[64];
+  uint8_t raw[34];
+  uint8_t i, code = 0, out = 1;
+  raw[0] = header;
+  memcpy(raw + 1, buf, len);
+  for(i = 0; i <= len; i++) {
+    if(raw[i]) frame[out++] = raw[i];
+    else {
+      frame[code] = out - code;
+      code = out++;
+    }
+  }
+  frame[code] = out - code;
+  frame[out++] = 0;
+  BENCH_send(frame, out);
+}
+
+// Host sends a BREAK (class request SEND_BREAK on EP0)
+static void BENCH_break(void) {
+  static const uint8_t setup[8] = {0x21, 0x23, 0xFF, 0xFF, 0, 0, 0, 0};
+  if(BENCH_verbose) printf("%9lu  usb    break\n", (unsigned long)MCS_cycles);
+  memcpy(BENCH_setup, setup, 8);
+  BENCH_setupPending = 1;
+}
+
+// ===================================================================================
+// SFR Access of the Core
+// ===================================================================================
+
+uint8_t MCS_readSFR(uint8_t addr) {
+  switch(addr) {
+    case ADDR(P3):                                          // IRQ pin from the NRF
+      return (REG(P3) & ~PIN_MASK(PIN_IRQ)) | (RFM_irq() ? PIN_MASK(PIN_IRQ) : 0);
+    case ADDR(SPI0_DATA):
+      return BENCH_spiData;
+    case ADDR(SPI0_STAT):                                   // free when transfer is done
+      if((int32_t)(MCS_cycles - BENCH_spiDone) >= 0) return REG(SPI0_STAT) | BIT(S0_FREE);
+      return REG(SPI0_STAT) & ~BIT(S0_FREE);
+    case ADDR(ROM_CTRL):                                    // ROM_STATUS
+      return ((REG(ROM_ADDR_H) == (DATA_FLASH_ADDR >> 8)) && !(REG(ROM_ADDR_L) & 1))
+             ? bROM_ADDR_OK : 0;
+    default:
+      return MCS_SFR(addr);
+  }
+}
+
+static void BENCH_loop(void);
+
+void MCS_writeSFR(uint8_t addr, uint8_t value) {
+  uint8_t old = MCS_SFR(addr);
+  MCS_SFR(addr) = value;
+  switch(addr) {
+    case ADDR(SPI0_DATA):                                   // start SPI transfer
+      BENCH_spiData = RFM_exchange(value);
+      BENCH_spiDone = MCS_cycles + 8 * (REG(SPI0_CK_SE) ? REG(SPI0_CK_SE) : 256);
+      BENCH_spiBytes++;
+      break;
+    case ADDR(ROM_CTRL):                                    // data flash command
+      if(MCS_readSFR(ADDR(ROM_CTRL)) & bROM_ADDR_OK) {
+        if(value == ROM_CMD_READ) REG(ROM_DATA_L) = BENCH_flash[REG(ROM_ADDR_L) >> 1];
+        else if((value == ROM_CMD_WRITE) && (REG(GLOBAL_CFG) & bDATA_WE)) {
+          BENCH_flash[REG(ROM_ADDR_L) >> 1] = REG(ROM_DATA_L);
+          BENCH_flashWrites++;
+        }
+      }
+      break;
+    case ADDR(USB_INT_FG):                                  // write 1 to clear flags
+      REG(USB_INT_FG) = old & ~(value & 0x1F);
+      break;
+    case ADDR(WDOG_COUNT):                                  // WDT_reset(): end of iteration
+      BENCH_loop();
+      break;
+  }
+
+  // NRF control pins
+  if((addr == PIN_PORT(PIN_CSN)) && ((old ^ value) & PIN_MASK(PIN_CSN))) {
+    RFM_select(value & PIN_MASK(PIN_CSN));
+    BENCH_checkIRQ();
+  }
+  if((addr == PIN_PORT(PIN_CE)) && ((old ^ value) & PIN_MASK(PIN_CE))) {
+    RFM_enable(value & PIN_MASK(PIN_CE));
+    BENCH_checkIRQ();
+  }
+}
+
+void MCS_writeBit(uint8_t addr, uint8_t mask, uint8_t value) {
+  uint8_t reg = value ? (MCS_SFR(addr) | mask) : (MCS_SFR(addr) & ~mask);
+  if((addr == ADDR(USB_INT_FG)) || (addr == ADDR(SPI0_STAT))) MCS_SFR(addr) = reg;
+  else MCS_writeSFR(addr, reg);
+}
+
+void MCS_enterISR(uint8_t n) {
+  if(n == INT_NO_GPIO) BENCH_gpioFlag = 0;                  // edge flag cleared by hardware
+}
+
+// ===================================================================================
+// Timer2, Interrupts and Main Loop Accounting
+// ===================================================================================
+
+// Advance timer2 (16-bit auto-reload mode)
+static void BENCH_timer2(uint8_t cycles) {
+  uint8_t  div;
+  uint16_t count;
+  if(!(REG(T2CON) & BIT(TR2))) return;
+  div = (REG(T2MOD) & bT2_CLK) ? ((REG(T2MOD) & bTMR_CLK) ? 1 : 4) : 12;
+  BENCH_t2Clock += cycles;
+  while(BENCH_t2Clock >= div) {
+    BENCH_t2Clock -= div;
+    count = REG(TL2) | (REG(TH2) << 8);
+    if(!++count) {
+      count = REG(RCAP2L) | (REG(RCAP2H) << 8);
+      REG(T2CON) |= BIT(TF2);
+    }
+    REG(TL2) = count;
+    REG(TH2) = count >> 8;
+  }
+}
+
+// Request pending and enabled interrupts
+static void BENCH_requests(void) {
+  if(!(REG(IE) & BIT(EA)) || (REG(IE) & BIT(E_DIS))) return;
+  if((REG(IE) & BIT(ET2)) && (REG(T2CON) & (BIT(TF2) | BIT(EXF2))))
+    MCS_interrupt(INT_NO_TMR2, REG(IP) & BIT(PT2));
+  if((REG(IE_EX) & BIT(IE_USB)) && (REG(USB_INT_FG) & REG(USB_INT_EN) & 0x1F))
+    MCS_interrupt(INT_NO_USB, REG(IP_EX) & bIP_USB);
+  if((REG(IE_EX) & BIT(IE_GPIO)) && BENCH_gpioFlag)
+    MCS_interrupt(INT_NO_GPIO, REG(IP_EX) & bIP_GPIO);
+}
+
+// Main loop iteration finished (WDT_reset)
+static void BENCH_loop(void) {
+  uint32_t len = (MCS_cycles - BENCH_loopStart) - (BENCH_isrTotal - BENCH_loopIsr);
+  BENCH_loops++;
+  if(!BENCH_idleLen) {                                      // learning idle length
+    if(len > BENCH_idleMax) BENCH_idleMax = len;
+  }
+  else if(len > BENCH_idleLen) {                            // did more than polling
+    BENCH_busy += len;
+    BENCH_busyLoops++;
+    BENCH_lastBusy = MCS_cycles;
+  }
+  BENCH_loopStart = MCS_cycles;
+  BENCH_loopIsr   = BENCH_isrTotal;
+}
+
+// Run the firmware for ms milliseconds
+static void BENCH_run(uint32_t ms) {
+  uint32_t end = MCS_cycles + ms * BENCH_MS;
+  uint8_t  level, vector, cycles;
+  while((int32_t)(end - MCS_cycles) > 0) {
+    BENCH_requests();
+    level  = MCS_level;
+    vector = MCS_vector;
+    cycles = MCS_step();
+    if(MCS_level > level) vector = MCS_vector;              // interrupt entered
+    if(MCS_level || level) {
+      BENCH_isr[vector] += cycles;
+      BENCH_isrTotal    += cycles;
+    }
+    BENCH_timer2(cycles);
+    if((int32_t)(MCS_cycles - BENCH_nextPoll) >= 0) {
+      BENCH_nextPoll += BENCH_USB_POLL;
+      BENCH_usbService();
+    }
+    if((int32_t)(MCS_cycles - BENCH_nextTick) >= 0) {
+      BENCH_nextTick += BENCH_MS;
+      RFM_tick();
+      BENCH_checkIRQ();
+    }
+  }
+}
+
+// ===================================================================================
+// Operations
+// ===================================================================================
+
+typedef struct {
+  uint32_t start, busy, loops, isr, spi, usb, flash, host;
+} bench_snap_t;
+
+static bench_snap_t BENCH_snap;
+
+// Remember counters before an operation
+static void BENCH_begin(void) {
+  BENCH_snap.start = MCS_cycles;
+  BENCH_snap.busy  = BENCH_busy;
+  BENCH_snap.loops = BENCH_busyLoops;
+  BENCH_snap.isr   = BENCH_isr[INT_NO_USB] + BENCH_isr[INT_NO_GPIO];
+  BENCH_snap.spi   = BENCH_spiBytes;
+  BENCH_snap.usb   = BENCH_usbPackets;
+  BENCH_snap.flash = BENCH_flashWrites;
+  BENCH_snap.host  = BENCH_hostBytes;
+  BENCH_lastBusy   = MCS_cycles;
+}
+
+// Run the operation for ms milliseconds and print its costs
+static void BENCH_end(const char *name, uint32_t ms) {
+  uint32_t fg, isr;
+  BENCH_run(ms);
+  fg  = BENCH_busy - BENCH_snap.busy;
+  isr = BENCH_isr[INT_NO_USB] + BENCH_isr[INT_NO_GPIO] - BENCH_snap.isr;
+  printf("%-32s %7lu %6lu %7lu %5lu %5lu %4lu %5lu %5lu %6.0fus\n", name,
+         (unsigned long)fg, (unsigned long)isr, (unsigned long)(fg + isr),
+         (unsigned long)(BENCH_busyLoops - BENCH_snap.loops),
+         (unsigned long)(BENCH_spiBytes - BENCH_snap.spi),
+         (unsigned long)(BENCH_usbPackets - BENCH_snap.usb),
+         (unsigned long)(BENCH_hostBytes - BENCH_snap.host),
+         (unsigned long)(BENCH_flashWrites - BENCH_snap.flash),
+         (double)(BENCH_lastBusy - BENCH_snap.start) * 1000000.0 / F_CPU);
+}
+
+// Send text from the host and measure
+static void BENCH_opSend(const char *name, const char *text) {
+  BENCH_begin();
+  BENCH_send(text, strlen(text));
+  BENCH_end(name, 10);
+}
+
+// Send packet via air and measure
+static void BENCH_opAir(const char *name, const char *buf) {
+  BENCH_begin();
+  BENCH_air(buf, strlen(buf));
+  BENCH_end(name, 10);
+}
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+
+int main(int argc, char **argv) {
+  const char *file = "nrf2cdc.ihx";
+  const char *payload = "0123456789abcdef0123456789ABCDEF";   // 32 bytes
+  uint32_t t2;
+  int i;
+
+  for(i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-v")) BENCH_verbose = 1;
+    else file = argv[i];
+  }
+
+  // Load firmware and reset
+  memset(BENCH_flash, 0xFF, sizeof(BENCH_flash));
+  MCS_reset();
+  RFM_reset();
+  if(!MCS_loadHex(file)) {
+    fprintf(stderr, "Cannot read %s\n", file);
+    return 1;
+  }
+  BENCH_nextPoll = BENCH_USB_POLL;
+  BENCH_nextTick = BENCH_MS;
+
+  // Start-up and idle main loop
+  BENCH_run(50);
+  BENCH_idleMax = 0;
+  t2 = BENCH_isr[INT_NO_TMR2];
+  BENCH_run(10);
+  BENCH_idleLen = BENCH_idleMax;
+  if(!BENCH_idleLen) {
+    fprintf(stderr, "Main loop not reached\n");
+    return 1;
+  }
+  printf("Firmware %s, cycles at %lu MHz\n", file, (unsigned long)(F_CPU / 1000000));
+  printf("idle main loop iteration: %lu cycles, timer2 interrupt: %lu cycles/ms\n\n",
+         (unsigned long)BENCH_idleLen, (unsigned long)(BENCH_isr[INT_NO_TMR2] - t2) / 10);
+
+  // Operations
+  printf("%-32s %7s %6s %7s %5s %5s %4s %5s %5s %8s\n", "operation",
+         "fg", "isr", "total", "loops", "SPI", "USB", "host", "flash", "latency");
+  BENCH_opSend("text: command !oDA",             "!oDA\n");
+  BENCH_opSend("text: command !c02",             "!c02\n");
+  BENCH_opSend("text: host -> radio 32 bytes",   "0123456789abcdef0123456789ABCDE\n");
+  BENCH_opAir ("text: radio -> host 32 bytes",   payload);
+
+  BENCH_opSend("binary: command !oB",            "!oB\n");
+  BENCH_begin();
+  BENCH_sendFrame(0x10, payload, 32);
+  BENCH_end("binary: host -> radio 32 bytes", 10);
+  BENCH_opAir ("binary: radio -> host 32 bytes", payload);
+  BENCH_begin();
+  BENCH_break();
+  BENCH_end("binary: break", 10);
+
+  BENCH_opSend("raw: command !oR",               "!oR\n");
+  BENCH_opSend("raw: host -> radio 32 bytes",    payload);
+  BENCH_opAir ("raw: radio -> host 32 bytes",    payload);
+  BENCH_begin();
+  BENCH_break();
+  BENCH_end("raw: break", 10);
+
+  BENCH_opSend("flash: save settings !w",        "!w\n");
+  return 0;
+}
@@ -0,0 +1,488 @@
+// ===================================================================================
+// Cycle-Counting MCS-51 Core with CH55x Extensions                           * v1.0 *
+// ===================================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include "mcs51.h"
+
+// Core registers in SFR space
+#define A_ACC           0xE0
+#define A_B             0xF0
+#define A_PSW           0xD0
+#define A_SP            0x81
+#define A_DPL           0x82
+#define A_DPH           0x83
+#define A_XBUS_AUX      0xA2
+#define A_P2            0xA0
+
+#define ACC             MCS_SFR(A_ACC)
+#define B               MCS_SFR(A_B)
+#define PSW             MCS_SFR(A_PSW)
+#define SP              MCS_SFR(A_SP)
+#define XBUS_AUX        MCS_SFR(A_XBUS_AUX)
+
+#define PSW_CY          0x80
+#define PSW_AC          0x40
+#define PSW_OV          0x04
+
+// Memories and state
+uint8_t  MCS_code[0x10000];
+uint8_t  MCS_xdata[0x10000];
+uint8_t  MCS_iram[0x100];
+uint8_t  MCS_sfr[0x80];
+uint16_t MCS_pc;
+uint8_t  MCS_level;
+uint8_t  MCS_vector;
+uint32_t MCS_cycles;
+
+static uint16_t MCS_dptr[2];          // DPTR0, DPTR1 (selected by XBUS_AUX bit 0)
+static uint8_t  MCS_stack[3];         // interrupted levels
+static uint8_t  MCS_vectors[3];       // interrupted vectors
+static uint8_t  MCS_depth;            // interrupt nesting depth
+static uint8_t  MCS_request;          // requested interrupt number + 1 (0: none)
+static uint8_t  MCS_requestHigh;      // requested interrupt has high priority
+static uint8_t  MCS_holdoff;          // no interrupt after RETI
+
+// Instruction lengths
+static const uint8_t MCS_LEN[256] = {
+//0 1 2 3 4 5 6 7 8 9 A B C D E F
+  1,2,3,1,1,2,1,1,1,1,1,1,1,1,1,1,  // 0x
+  3,2,3,1,1,2,1,1,1,1,1,1,1,1,1,1,  // 1x
+  3,2,1,1,2,2,1,1,1,1,1,1,1,1,1,1,  // 2x
+  3,2,1,1,2,2,1,1,1,1,1,1,1,1,1,1,  // 3x
+  2,2,2,3,2,2,1,1,1,1,1,1,1,1,1,1,  // 4x
+  2,2,2,3,2,2,1,1,1,1,1,1,1,1,1,1,  // 5x
+  2,2,2,3,2,2,1,1,1,1,1,1,1,1,1,1,  // 6x
+  2,2,2,1,2,3,2,2,2,2,2,2,2,2,2,2,  // 7x
+  2,2,2,1,1,3,2,2,2,2,2,2,2,2,2,2,  // 8x
+  3,2,2,1,2,2,1,1,1,1,1,1,1,1,1,1,  // 9x
+  2,2,2,1,1,1,2,2,2,2,2,2,2,2,2,2,  // Ax
+  2,2,2,1,3,3,3,3,3,3,3,3,3,3,3,3,  // Bx
+  2,2,2,1,1,2,1,1,1,1,1,1,1,1,1,1,  // Cx
+  2,2,2,1,1,3,1,1,2,2,2,2,2,2,2,2,  // Dx
+  1,2,1,1,1,2,1,1,1,1,1,1,1,1,1,1,  // Ex
+  1,2,1,1,1,2,1,1,1,1,1,1,1,1,1,1   // Fx
+};
+
+// ===================================================================================
+// Memory Access
+// ===================================================================================
+
+// Register R0..R7 of the current bank
+#define REG(n)          MCS_iram[(PSW & 0x18) + (n)]
+
+// Read SFR (core registers directly, others via the peripheral models)
+static uint8_t MCS_getSFR(uint8_t addr) {
+  switch(addr) {
+    case A_ACC:
+    case A_B:
+    case A_SP:
+    case A_XBUS_AUX:  return MCS_SFR(addr);
+    case A_PSW: {                                 // parity of ACC in bit 0
+      uint8_t p = ACC;
+      p ^= p >> 4; p ^= p >> 2; p ^= p >> 1;
+      return (PSW & 0xFE) | (p & 1);
+    }
+    case A_DPL:       return MCS_dptr[XBUS_AUX & 1];
+    case A_DPH:       return MCS_dptr[XBUS_AUX & 1] >> 8;
+    default:          return MCS_readSFR(addr);
+  }
+}
+
+// Write SFR
+static void MCS_setSFR(uint8_t addr, uint8_t value) {
+  uint16_t *dptr = &MCS_dptr[XBUS_AUX & 1];
+  switch(addr) {
+    case A_ACC:
+    case A_B:
+    case A_SP:
+    case A_PSW:
+    case A_XBUS_AUX:  MCS_SFR(addr) = value; break;
+    case A_DPL:       *dptr = (*dptr & 0xFF00) | value; break;
+    case A_DPH:       *dptr = (*dptr & 0x00FF) | (value << 8); break;
+    default:          MCS_writeSFR(addr, value); break;
+  }
+}
+
+// Direct address: internal RAM 00-7F or SFR 80-FF
+static uint8_t MCS_getDirect(uint8_t addr) {
+  return (addr < 0x80) ? MCS_iram[addr] : MCS_getSFR(addr);
+}
+
+static void MCS_setDirect(uint8_t addr, uint8_t value) {
+  if(addr < 0x80) MCS_iram[addr] = value;
+  else MCS_setSFR(addr, value);
+}
+
+// Bit address: 20-2F in internal RAM or bit-addressable SFR (address & 0xF8)
+static uint8_t MCS_getBit(uint8_t bit) {
+  uint8_t mask = 1 << (bit & 7);
+  if(bit < 0x80) return (MCS_iram[0x20 + (bit >> 3)] & mask) ? 1 : 0;
+  return (MCS_getSFR(bit & 0xF8) & mask) ? 1 : 0;
+}
+
+static void MCS_setBit(uint8_t bit, uint8_t value) {
+  uint8_t mask = 1 << (bit & 7);
+  uint8_t addr = bit & 0xF8;
+  if(bit < 0x80) {
+    if(value) MCS_iram[0x20 + (bit >> 3)] |=  mask;
+    else      MCS_iram[0x20 + (bit >> 3)] &= ~mask;
+  }
+  else if((addr == A_ACC) || (addr == A_B) || (addr == A_PSW))
+    MCS_setSFR(addr, value ? (MCS_getSFR(addr) | mask) : (MCS_getSFR(addr) & ~mask));
+  else MCS_writeBit(addr, mask, value);
+}
+
+// Stack
+static void MCS_push(uint8_t value) {
+  MCS_iram[++SP] = value;
+}
+
+static uint8_t MCS_pop(void) {
+  return MCS_iram[SP--];
+}
+
+// Carry flag
+#define CY              ((PSW & PSW_CY) ? 1 : 0)
+#define SET_CY(c)       PSW = (c) ? (PSW | PSW_CY) : (PSW & ~PSW_CY)
+
+// ===================================================================================
+// Arithmetic
+// ===================================================================================
+
+static void MCS_add(uint8_t value, uint8_t carry) {
+  uint16_t sum = ACC + value + carry;
+  uint8_t  nib = (ACC & 0x0F) + (value & 0x0F) + carry;
+  int16_t  sgn = (int8_t)ACC + (int8_t)value + carry;
+  PSW &= ~(PSW_CY | PSW_AC | PSW_OV);
+  if(sum > 0xFF)               PSW |= PSW_CY;
+  if(nib > 0x0F)               PSW |= PSW_AC;
+  if((sgn < -128) || (sgn > 127)) PSW |= PSW_OV;
+  ACC = sum;
+}
+
+static void MCS_subb(uint8_t value) {
+  uint8_t  carry = CY;
+  int16_t  dif = ACC - value - carry;
+  int16_t  nib = (ACC & 0x0F) - (value & 0x0F) - carry;
+  int16_t  sgn = (int8_t)ACC - (int8_t)value - carry;
+  PSW &= ~(PSW_CY | PSW_AC | PSW_OV);
+  if(dif < 0)                  PSW |= PSW_CY;
+  if(nib < 0)                  PSW |= PSW_AC;
+  if((sgn < -128) || (sgn > 127)) PSW |= PSW_OV;
+  ACC = dif;
+}
+
+// ===================================================================================
+// Core Functions
+// ===================================================================================
+
+// Reset core
+void MCS_reset(void) {
+  memset(MCS_iram, 0, sizeof(MCS_iram));
+  memset(MCS_sfr,  0, sizeof(MCS_sfr));
+  MCS_dptr[0] = MCS_dptr[1] = 0;
+  SP          = 0x07;
+  MCS_SFR(A_P2) = 0xFF;
+  MCS_pc      = 0;
+  MCS_level   = 0;
+  MCS_depth   = 0;
+  MCS_request = 0;
+  MCS_holdoff = 0;
+  MCS_cycles  = 0;
+}
+
+// Load Intel HEX file into code memory
+uint8_t MCS_loadHex(const char *file) {
+  char line[600];
+  unsigned int len, addr, type, value, i;
+  FILE *f = fopen(file, "r");
+  if(!f) return 0;
+  memset(MCS_code, 0xFF, sizeof(MCS_code));
+  while(fgets(line, sizeof(line), f)) {
+    if(line[0] != ':') continue;
+    if(sscanf(line + 1, "%2x%4x%2x", &len, &addr, &type) != 3) break;
+    if(type == 1) break;                          // end of file record
+    if(type != 0) continue;                       // data records only
+    for(i = 0; i < len; i++) {
+      if(sscanf(line + 9 + 2 * i, "%2x", &value) != 1) break;
+      MCS_code[(addr + i) & 0xFFFF] = value;
+    }
+  }
+  fclose(f);
+  return 1;
+}
+
+// Request interrupt n for the next step
+void MCS_interrupt(uint8_t n, uint8_t high) {
+  high = high ? 1 : 0;
+  if(!MCS_request || (high && !MCS_requestHigh) || ((high == MCS_requestHigh) && (n + 1 < MCS_request))) {
+    MCS_request     = n + 1;
+    MCS_requestHigh = high;
+  }
+}
+
+// Execute one instruction or enter a requested interrupt, return cycles
+uint8_t MCS_step(void) {
+  uint8_t  op, a1, a2, tmp, cycles;
+  uint16_t pc, addr;
+  int8_t   rel;
+
+  // Enter interrupt: lower priority than running service routine is held off
+  if(MCS_request && !MCS_holdoff && (MCS_level < (MCS_requestHigh ? 2 : 1))) {
+    tmp = MCS_request - 1;
+    MCS_request = 0;
+    MCS_stack[MCS_depth]   = MCS_level;
+    MCS_vectors[MCS_depth] = MCS_vector;
+    MCS_depth++;
+    MCS_level  = MCS_requestHigh ? 2 : 1;
+    MCS_vector = tmp;
+    MCS_push(MCS_pc);
+    MCS_push(MCS_pc >> 8);
+    MCS_pc = 8 * tmp + 3;
+    MCS_enterISR(tmp);
+    MCS_cycles += 3;
+    return 3;
+  }
+  MCS_request = 0;
+  MCS_holdoff = 0;
+
+  // Fetch
+  pc     = MCS_pc;
+  op     = MCS_code[pc];
+  a1     = MCS_code[(uint16_t)(pc + 1)];
+  a2     = MCS_code[(uint16_t)(pc + 2)];
+  cycles = MCS_LEN[op];
+  MCS_pc = pc + MCS_LEN[op];
+
+  // Low nibble 8-F: Rn, 6-7: @Ri (for the regular rows)
+  #define RN            REG(op & 7)
+  #define RI            MCS_iram[REG(op & 1)]
+
+  switch(op) {
+    case 0x00: break;                                           // NOP
+
+    // AJMP / ACALL
+    case 0x01: case 0x21: case 0x41: case 0x61:
+    case 0x81: case 0xA1: case 0xC1: case 0xE1:
+      MCS_pc = (MCS_pc & 0xF800) | ((op & 0xE0) << 3) | a1;
+      break;
+    case 0x11: case 0x31: case 0x51: case 0x71:
+    case 0x91: case 0xB1: case 0xD1: case 0xF1:
+      MCS_push(MCS_pc); MCS_push(MCS_pc >> 8);
+      MCS_pc = (MCS_pc & 0xF800) | ((op & 0xE0) << 3) | a1;
+      break;
+
+    case 0x02: MCS_pc = (a1 << 8) | a2; break;                  // LJMP
+    case 0x12:                                                  // LCALL
+      MCS_push(MCS_pc); MCS_push(MCS_pc >> 8);
+      MCS_pc = (a1 << 8) | a2;
+      break;
+    case 0x22:                                                  // RET
+      MCS_pc = MCS_pop() << 8; MCS_pc |= MCS_pop();
+      cycles = 2;
+      break;
+    case 0x32:                                                  // RETI
+      MCS_pc = MCS_pop() << 8; MCS_pc |= MCS_pop();
+      if(MCS_depth) {
+        MCS_depth--;
+        MCS_level  = MCS_stack[MCS_depth];
+        MCS_vector = MCS_vectors[MCS_depth];
+      }
+      MCS_holdoff = 1;
+      cycles = 2;
+      break;
+    case 0x73: MCS_pc = ACC + MCS_dptr[XBUS_AUX & 1]; break;    // JMP @A+DPTR
+
+    // Rotates and accumulator operations
+    case 0x03: ACC = (ACC >> 1) | (ACC << 7); break;            // RR A
+    case 0x13: tmp = ACC & 1; ACC = (ACC >> 1) | (CY << 7); SET_CY(tmp); break;
+    case 0x23: ACC = (ACC << 1) | (ACC >> 7); break;            // RL A
+    case 0x33: tmp = ACC >> 7; ACC = (ACC << 1) | CY; SET_CY(tmp); break;
+    case 0xC4: ACC = (ACC << 4) | (ACC >> 4); break;            // SWAP A
+    case 0xE4: ACC = 0; break;                                  // CLR A
+    case 0xF4: ACC = ~ACC; break;                               // CPL A
+    case 0xD4: {                                                // DA A
+      uint16_t v = ACC;
+      if(((v & 0x0F) > 9) || (PSW & PSW_AC)) v += 0x06;
+      if(v > 0xFF) PSW |= PSW_CY;
+      if((((v >> 4) & 0x0F) > 9) || (PSW & PSW_CY) || (v > 0xFF)) v += 0x60;
+      if(v > 0xFF) PSW |= PSW_CY;
+      ACC = v;
+      break;
+    }
+    case 0xA4: {                                                // MUL AB
+      uint16_t p = ACC * B;
+      ACC = p; B = p >> 8;
+      PSW &= ~(PSW_CY | PSW_OV);
+      if(p > 0xFF) PSW |= PSW_OV;
+      cycles = 4;
+      break;
+    }
+    case 0x84:                                                  // DIV AB
+      PSW &= ~(PSW_CY | PSW_OV);
+      if(!B) PSW |= PSW_OV;
+      else { tmp = ACC % B; ACC = ACC / B; B = tmp; }
+      cycles = 4;
+      break;
+
+    // INC / DEC
+    case 0x04: ACC++; break;
+    case 0x05: MCS_setDirect(a1, MCS_getDirect(a1) + 1); break;
+    case 0x06: case 0x07: RI++; break;
+    case 0x08: case 0x09: case 0x0A: case 0x0B:
+    case 0x0C: case 0x0D: case 0x0E: case 0x0F: RN++; break;
+    case 0x14: ACC--; break;
+    case 0x15: MCS_setDirect(a1, MCS_getDirect(a1) - 1); break;
+    case 0x16: case 0x17: RI--; break;
+    case 0x18: case 0x19: case 0x1A: case 0x1B:
+    case 0x1C: case 0x1D: case 0x1E: case 0x1F: RN--; break;
+    case 0xA3: MCS_dptr[XBUS_AUX & 1]++; break;                 // INC DPTR
+
+    // Conditional jumps
+    case 0x10:                                                  // JBC bit,rel
+      if(MCS_getBit(a1)) { MCS_setBit(a1, 0); MCS_pc += (int8_t)a2; }
+      break;
+    case 0x20: if( MCS_getBit(a1)) MCS_pc += (int8_t)a2; break; // JB
+    case 0x30: if(!MCS_getBit(a1)) MCS_pc += (int8_t)a2; break; // JNB
+    case 0x40: if( CY)   MCS_pc += (int8_t)a1; break;           // JC
+    case 0x50: if(!CY)   MCS_pc += (int8_t)a1; break;           // JNC
+    case 0x60: if(!ACC)  MCS_pc += (int8_t)a1; break;           // JZ
+    case 0x70: if( ACC)  MCS_pc += (int8_t)a1; break;           // JNZ
+    case 0x80: MCS_pc += (int8_t)a1; break;                     // SJMP
+    case 0xD5:                                                  // DJNZ dir,rel
+      tmp = MCS_getDirect(a1) - 1;
+      MCS_setDirect(a1, tmp);
+      if(tmp) MCS_pc += (int8_t)a2;
+      break;
+    case 0xD8: case 0xD9: case 0xDA: case 0xDB:
+    case 0xDC: case 0xDD: case 0xDE: case 0xDF:                 // DJNZ Rn,rel
+      if(--RN) MCS_pc += (int8_t)a1;
+      break;
+    case 0xB4: tmp = a1;              goto cjne;                // CJNE A,#,rel
+    case 0xB5: tmp = MCS_getDirect(a1); goto cjne;              // CJNE A,dir,rel
+    cjne:
+      rel = a2;
+      SET_CY(ACC < tmp);
+      if(ACC != tmp) MCS_pc += rel;
+      break;
+    case 0xB6: case 0xB7:                                       // CJNE @Ri,#,rel
+      SET_CY(RI < a1);
+      if(RI != a1) MCS_pc += (int8_t)a2;
+      break;
+    case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+    case 0xBC: case 0xBD: case 0xBE: case 0xBF:                 // CJNE Rn,#,rel
+      SET_CY(RN < a1);
+      if(RN != a1) MCS_pc += (int8_t)a2;
+      break;
+
+    // ADD / ADDC / SUBB
+    case 0x24: MCS_add(a1, 0); break;
+    case 0x25: MCS_add(MCS_getDirect(a1), 0); break;
+    case 0x26: case 0x27: MCS_add(RI, 0); break;
+    case 0x28: case 0x29: case 0x2A: case 0x2B:
+    case 0x2C: case 0x2D: case 0x2E: case 0x2F: MCS_add(RN, 0); break;
+    case 0x34: MCS_add(a1, CY); break;
+    case 0x35: MCS_add(MCS_getDirect(a1), CY); break;
+    case 0x36: case 0x37: MCS_add(RI, CY); break;
+    case 0x38: case 0x39: case 0x3A: case 0x3B:
+    case 0x3C: case 0x3D: case 0x3E: case 0x3F: MCS_add(RN, CY); break;
+    case 0x94: MCS_subb(a1); break;
+    case 0x95: MCS_subb(MCS_getDirect(a1)); break;
+    case 0x96: case 0x97: MCS_subb(RI); break;
+    case 0x98: case 0x99: case 0x9A: case 0x9B:
+    case 0x9C: case 0x9D: case 0x9E: case 0x9F: MCS_subb(RN); break;
+
+    // ORL / ANL / XRL
+    case 0x42: MCS_setDirect(a1, MCS_getDirect(a1) | ACC); break;
+    case 0x43: MCS_setDirect(a1, MCS_getDirect(a1) | a2);  break;
+    case 0x44: ACC |= a1; break;
+    case 0x45: ACC |= MCS_getDirect(a1); break;
+    case 0x46: case 0x47: ACC |= RI; break;
+    case 0x48: case 0x49: case 0x4A: case 0x4B:
+    case 0x4C: case 0x4D: case 0x4E: case 0x4F: ACC |= RN; break;
+    case 0x52: MCS_setDirect(a1, MCS_getDirect(a1) & ACC); break;
+    case 0x53: MCS_setDirect(a1, MCS_getDirect(a1) & a2);  break;
+    case 0x54: ACC &= a1; break;
+    case 0x55: ACC &= MCS_getDirect(a1); break;
+    case 0x56: case 0x57: ACC &= RI; break;
+    case 0x58: case 0x59: case 0x5A: case 0x5B:
+    case 0x5C: case 0x5D: case 0x5E: case 0x5F: ACC &= RN; break;
+    case 0x62: MCS_setDirect(a1, MCS_getDirect(a1) ^ ACC); break;
+    case 0x63: MCS_setDirect(a1, MCS_getDirect(a1) ^ a2);  break;
+    case 0x64: ACC ^= a1; break;
+    case 0x65: ACC ^= MCS_getDirect(a1); break;
+    case 0x66: case 0x67: ACC ^= RI; break;
+    case 0x68: case 0x69: case 0x6A: case 0x6B:
+    case 0x6C: case 0x6D: case 0x6E: case 0x6F: ACC ^= RN; break;
+
+    // Carry and bit operations
+    case 0x72: SET_CY(CY |  MCS_getBit(a1)); break;             // ORL C,bit
+    case 0xA0: SET_CY(CY | !MCS_getBit(a1)); break;             // ORL C,/bit
+    case 0x82: SET_CY(CY &  MCS_getBit(a1)); break;             // ANL C,bit
+    case 0xB0: SET_CY(CY & !MCS_getBit(a1)); break;             // ANL C,/bit
+    case 0x92: MCS_setBit(a1, CY); break;                       // MOV bit,C
+    case 0xA2: SET_CY(MCS_getBit(a1)); break;                   // MOV C,bit
+    case 0xB2: MCS_setBit(a1, !MCS_getBit(a1)); break;          // CPL bit
+    case 0xB3: PSW ^= PSW_CY; break;                            // CPL C
+    case 0xC2: MCS_setBit(a1, 0); break;                        // CLR bit
+    case 0xC3: PSW &= ~PSW_CY; break;                           // CLR C
+    case 0xD2: MCS_setBit(a1, 1); break;                        // SETB bit
+    case 0xD3: PSW |= PSW_CY; break;                            // SETB C
+
+    // MOV
+    case 0x74: ACC = a1; break;
+    case 0x75: MCS_setDirect(a1, a2); break;
+    case 0x76: case 0x77: RI = a1; break;
+    case 0x78: case 0x79: case 0x7A: case 0x7B:
+    case 0x7C: case 0x7D: case 0x7E: case 0x7F: RN = a1; break;
+    case 0x85: MCS_setDirect(a2, MCS_getDirect(a1)); break;     // MOV dir,dir (src first)
+    case 0x86: case 0x87: MCS_setDirect(a1, RI); break;
+    case 0x88: case 0x89: case 0x8A: case 0x8B:
+    case 0x8C: case 0x8D: case 0x8E: case 0x8F: MCS_setDirect(a1, RN); break;
+    case 0x90: MCS_dptr[XBUS_AUX & 1] = (a1 << 8) | a2; break;  // MOV DPTR,#
+    case 0xA6: case 0xA7: RI = MCS_getDirect(a1); break;
+    case 0xA8: case 0xA9: case 0xAA: case 0xAB:
+    case 0xAC: case 0xAD: case 0xAE: case 0xAF: RN = MCS_getDirect(a1); break;
+    case 0xE5: ACC = MCS_getDirect(a1); break;
+    case 0xE6: case 0xE7: ACC = RI; break;
+    case 0xE8: case 0xE9: case 0xEA: case 0xEB:
+    case 0xEC: case 0xED: case 0xEE: case 0xEF: ACC = RN; break;
+    case 0xF5: MCS_setDirect(a1, ACC); break;
+    case 0xF6: case 0xF7: RI = ACC; break;
+    case 0xF8: case 0xF9: case 0xFA: case 0xFB:
+    case 0xFC: case 0xFD: case 0xFE: case 0xFF: RN = ACC; break;
+
+    // MOVC / MOVX
+    case 0x83: ACC = MCS_code[(uint16_t)(MCS_pc + ACC)]; cycles = 2; break;
+    case 0x93: ACC = MCS_code[(uint16_t)(MCS_dptr[XBUS_AUX & 1] + ACC)]; cycles = 2; break;
+    case 0xE0: ACC = MCS_xdata[MCS_dptr[XBUS_AUX & 1]]; break;
+    case 0xF0: MCS_xdata[MCS_dptr[XBUS_AUX & 1]] = ACC; break;
+    case 0xE2: case 0xE3:
+      addr = (MCS_getSFR(A_P2) << 8) | REG(op & 1);
+      ACC = MCS_xdata[addr];
+      break;
+    case 0xF2: case 0xF3:
+      addr = (MCS_getSFR(A_P2) << 8) | REG(op & 1);
+      MCS_xdata[addr] = ACC;
+      break;
+    case 0xA5: MCS_xdata[MCS_dptr[1]++] = ACC; break;           // CH55x: MOVX @DPTR1,A
+
+    // Stack and exchange
+    case 0xC0: MCS_push(MCS_getDirect(a1)); break;
+    case 0xD0: MCS_setDirect(a1, MCS_pop()); break;
+    case 0xC5: tmp = MCS_getDirect(a1); MCS_setDirect(a1, ACC); ACC = tmp; break;
+    case 0xC6: case 0xC7: tmp = RI; RI = ACC; ACC = tmp; break;
+    case 0xC8: case 0xC9: case 0xCA: case 0xCB:
+    case 0xCC: case 0xCD: case 0xCE: case 0xCF: tmp = RN; RN = ACC; ACC = tmp; break;
+    case 0xD6: case 0xD7:                                       // XCHD A,@Ri
+      tmp = RI;
+      RI  = (tmp & 0xF0) | (ACC & 0x0F);
+      ACC = (ACC & 0xF0) | (tmp & 0x0F);
+      break;
+  }
+
+  MCS_cycles += cycles;
+  return cycles;
+}
@@ -0,0 +1,50 @@
+// ===================================================================================
+// Cycle-Counting MCS-51 Core with CH55x Extensions                           * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// MCS_reset()              reset core: PC = 0, SP = 7, registers and RAM cleared
+// MCS_loadHex(file)        load Intel HEX file into code memory, returns 0 on error
+// MCS_step()               execute one instruction (or enter an interrupt),
+//                          returns the clock cycles it took
+// MCS_interrupt(n, high)   request interrupt number n (vector 8*n+3) with priority
+//
+// The core executes the complete MCS-51 instruction set plus the CH55x extensions
+// the firmware uses: DPTR0/DPTR1 selected by XBUS_AUX bit 0 and the MOVX @DPTR1,A
+// instruction (0xA5). ACC, B, PSW, SP, DPL, DPH and XBUS_AUX are handled by the core;
+// all other SFR accesses go to the hooks below, which the peripheral models provide.
+//
+// Cycles: the CH55x executes most instructions in one clock per instruction byte
+// (see the timing notes in delay.c). The core counts the instruction length in
+// clocks, MUL/DIV with 4, MOVC and RET/RETI with 2 and interrupt entry with 3. This
+// is an approximation of the datasheet's instruction timing table; relative figures
+// (before/after a change) are what the harness is meant for.
+
+#pragma once
+#include <stdint.h>
+
+// Memories
+extern uint8_t  MCS_code[0x10000];    // code memory (MOVC)
+extern uint8_t  MCS_xdata[0x10000];   // external RAM (MOVX)
+extern uint8_t  MCS_iram[0x100];      // internal RAM (direct 00-7F, indirect 00-FF)
+extern uint8_t  MCS_sfr[0x80];        // SFR storage for the peripheral models
+extern uint16_t MCS_pc;               // program counter
+extern uint8_t  MCS_level;            // interrupt nesting: 0 none, 1 low, 2 high
+extern uint8_t  MCS_vector;           // interrupt number currently being served
+extern uint32_t MCS_cycles;           // clock cycles since reset
+
+// SFR access
+#define MCS_SFR(addr)   MCS_sfr[(addr) - 0x80]
+
+// Core functions
+void    MCS_reset(void);
+uint8_t MCS_loadHex(const char *file);
+uint8_t MCS_step(void);
+void    MCS_interrupt(uint8_t n, uint8_t high);
+
+// Provided by the peripheral models
+uint8_t MCS_readSFR(uint8_t addr);                    // read SFR (also for read-modify-write)
+void    MCS_writeSFR(uint8_t addr, uint8_t value);    // write SFR
+void    MCS_writeBit(uint8_t addr, uint8_t mask, uint8_t value); // write single SFR bit
+void    MCS_enterISR(uint8_t n);                      // interrupt n is being entered
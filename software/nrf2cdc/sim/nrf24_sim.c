@@ -0,0 +1,314 @@
+// ===================================================================================
+// nRF24L01+ Register and FIFO Model for the Host Simulation                  * v1.0 *
+// ===================================================================================
+
+#include <string.h>
+#include "nrf24_sim.h"
+
+// Registers
+#define REG_CONFIG          0x00
+#define REG_EN_AA           0x01
+#define REG_EN_RXADDR       0x02
+#define REG_SETUP_AW        0x03
+#define REG_SETUP_RETR      0x04
+#define REG_RF_CH           0x05
+#define REG_RF_SETUP        0x06
+#define REG_STATUS          0x07
+#define REG_OBSERVE_TX      0x08
+#define REG_RX_ADDR_P0      0x0A
+#define REG_RX_ADDR_P1      0x0B
+#define REG_TX_ADDR         0x10
+#define REG_RX_PW_P0        0x11
+#define REG_FIFO_STATUS     0x17
+#define REG_DYNPD           0x1C
+#define REG_FEATURE         0x1D
+#define REG_COUNT           0x1E
+
+// Commands
+#define CMD_R_REGISTER      0x00
+#define CMD_W_REGISTER      0x20
+#define CMD_R_RX_PL_WID     0x60
+#define CMD_R_RX_PAYLOAD    0x61
+#define CMD_W_TX_PAYLOAD    0xA0
+#define CMD_W_TX_NOACK      0xB0
+#define CMD_FLUSH_TX        0xE1
+#define CMD_FLUSH_RX        0xE2
+#define CMD_REUSE_TX_PL     0xE3
+#define CMD_NOP             0xFF
+
+// Status flags
+#define ST_RX_DR            0x40
+#define ST_TX_DS            0x20
+#define ST_MAX_RT           0x10
+#define ST_IRQ_MASK         0x70
+
+// FIFO entry
+typedef struct {
+  uint8_t pipe;                       // RX: pipe number, TX: no-ACK flag
+  uint8_t len;
+  uint8_t data[32];
+} rfm_fifo_t;
+
+// Model state
+static uint8_t RFM_reg[REG_COUNT];    // single-byte registers
+static uint8_t RFM_addr[3][5];        // RX_ADDR_P0, RX_ADDR_P1, TX_ADDR
+static rfm_fifo_t RFM_rx[3];          // RX FIFO
+static rfm_fifo_t RFM_tx[3];          // TX FIFO
+static uint8_t RFM_rxCount, RFM_txCount;
+static uint8_t RFM_cmd;               // command of current transaction
+static uint8_t RFM_index;             // byte index in current transaction
+static rfm_fifo_t RFM_wr;             // payload being written
+static uint8_t RFM_ce;                // CE pin level
+static uint8_t RFM_txActive;          // transmission in progress
+static uint8_t RFM_txWait;            // waiting for RFM_txResult()
+static uint8_t RFM_txNoAck;           // current transmission expects no ACK
+
+// Statistics
+uint32_t RFM_transactions, RFM_bytes, RFM_sent, RFM_acked, RFM_received, RFM_lost;
+
+// ===================================================================================
+// Helpers
+// ===================================================================================
+
+// Address register -> index into RFM_addr, or -1 for single-byte registers
+static int RFM_addrIndex(uint8_t reg) {
+  if(reg == REG_RX_ADDR_P0) return 0;
+  if(reg == REG_RX_ADDR_P1) return 1;
+  if(reg == REG_TX_ADDR)    return 2;
+  return -1;
+}
+
+// Status register including RX pipe number and TX FIFO full flag
+static uint8_t RFM_status(void) {
+  uint8_t status = RFM_reg[REG_STATUS] & ST_IRQ_MASK;
+  status |= (RFM_rxCount ? RFM_rx[0].pipe : 7) << 1;
+  if(RFM_txCount == 3) status |= 0x01;
+  return status;
+}
+
+// FIFO status register
+static uint8_t RFM_fifoStatus(void) {
+  uint8_t fifo = 0;
+  if(RFM_txCount == 3) fifo |= 0x20;
+  if(!RFM_txCount)     fifo |= 0x10;
+  if(RFM_rxCount == 3) fifo |= 0x02;
+  if(!RFM_rxCount)     fifo |= 0x01;
+  return fifo;
+}
+
+// Read byte i of a register
+static uint8_t RFM_readReg(uint8_t reg, uint8_t i) {
+  int a = RFM_addrIndex(reg);
+  if(a >= 0) return (i < 5) ? RFM_addr[a][i] : 0;
+  if(i) return 0;
+  if(reg == REG_STATUS)      return RFM_status();
+  if(reg == REG_FIFO_STATUS) return RFM_fifoStatus();
+  return (reg < REG_COUNT) ? RFM_reg[reg] : 0;
+}
+
+// Write byte i of a register
+static void RFM_writeReg(uint8_t reg, uint8_t i, uint8_t value) {
+  int a = RFM_addrIndex(reg);
+  if(a >= 0) {
+    if(i < 5) RFM_addr[a][i] = value;
+    return;
+  }
+  if(i || (reg >= REG_COUNT) || (reg == REG_FIFO_STATUS)) return;
+  if(reg == REG_STATUS) RFM_reg[REG_STATUS] &= ~(value & ST_IRQ_MASK); // write 1 to clear
+  else RFM_reg[reg] = value;
+}
+
+// Remove first entry of a FIFO
+static void RFM_pop(rfm_fifo_t *fifo, uint8_t *count) {
+  if(!*count) return;
+  memmove(fifo, fifo + 1, sizeof(rfm_fifo_t) * 2);
+  (*count)--;
+}
+
+// Powered up in TX mode with CE high and something to send -> start transmission
+static void RFM_checkTX(void) {
+  if(RFM_ce && RFM_txCount && ((RFM_reg[REG_CONFIG] & 0x03) == 0x02))
+    RFM_txActive = 1;
+}
+
+// ===================================================================================
+// Model Functions
+// ===================================================================================
+
+// Power-on reset
+void RFM_reset(void) {
+  memset(RFM_reg, 0, sizeof(RFM_reg));
+  RFM_reg[REG_CONFIG]     = 0x08;
+  RFM_reg[REG_EN_AA]      = 0x3F;
+  RFM_reg[REG_EN_RXADDR]  = 0x03;
+  RFM_reg[REG_SETUP_AW]   = 0x03;
+  RFM_reg[REG_SETUP_RETR] = 0x03;
+  RFM_reg[REG_RF_CH]      = 0x02;
+  RFM_reg[REG_RF_SETUP]   = 0x0E;
+  memset(RFM_addr[0], 0xE7, 5);
+  memset(RFM_addr[1], 0xC2, 5);
+  memset(RFM_addr[2], 0xE7, 5);
+  RFM_rxCount = RFM_txCount = 0;
+  RFM_txActive = RFM_txWait = 0;
+  RFM_index = 0;
+}
+
+// CSN pin changed
+void RFM_select(uint8_t csn) {
+  if(!csn) {                                      // start of transaction
+    RFM_transactions++;
+    RFM_index = 0;
+    return;
+  }
+  if(RFM_index < 2) return;                       // end of transaction with data:
+  if(RFM_cmd == CMD_R_RX_PAYLOAD) RFM_pop(RFM_rx, &RFM_rxCount);
+  if(((RFM_cmd == CMD_W_TX_PAYLOAD) || (RFM_cmd == CMD_W_TX_NOACK)) && (RFM_txCount < 3)) {
+    RFM_wr.pipe = (RFM_cmd == CMD_W_TX_NOACK);
+    RFM_tx[RFM_txCount++] = RFM_wr;
+    RFM_checkTX();
+  }
+  if((RFM_cmd & 0xE0) == CMD_W_REGISTER) RFM_checkTX();
+}
+
+// Clock one SPI byte
+uint8_t RFM_exchange(uint8_t mosi) {
+  uint8_t i = RFM_index++;
+  RFM_bytes++;
+  if(!i) {                                        // command byte -> status
+    RFM_cmd = mosi;
+    switch(mosi) {
+      case CMD_FLUSH_TX:  RFM_txCount = 0; RFM_txActive = RFM_txWait = 0; break;
+      case CMD_FLUSH_RX:  RFM_rxCount = 0; break;
+      case CMD_W_TX_PAYLOAD:
+      case CMD_W_TX_NOACK: RFM_wr.len = 0; break;
+      default: break;
+    }
+    return RFM_status();
+  }
+  i--;                                            // index of data byte
+  if(RFM_cmd < CMD_W_REGISTER) return RFM_readReg(RFM_cmd, i);
+  if(RFM_cmd < 0x40) {
+    RFM_writeReg(RFM_cmd & 0x1F, i, mosi);
+    return 0;
+  }
+  switch(RFM_cmd) {
+    case CMD_R_RX_PL_WID:
+      return (RFM_rxCount && !i) ? RFM_rx[0].len : 0;
+    case CMD_R_RX_PAYLOAD:
+      return (RFM_rxCount && (i < 32)) ? RFM_rx[0].data[i] : 0;
+    case CMD_W_TX_PAYLOAD:
+    case CMD_W_TX_NOACK:
+      if(i < 32) RFM_wr.data[RFM_wr.len++] = mosi;
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+// CE pin changed
+void RFM_enable(uint8_t ce) {
+  RFM_ce = ce;
+  RFM_checkTX();
+}
+
+// IRQ pin level (active low)
+uint8_t RFM_irq(void) {
+  return !(RFM_reg[REG_STATUS] & ST_IRQ_MASK & ~RFM_reg[REG_CONFIG]);
+}
+
+// Advance one millisecond
+void RFM_tick(void) {
+  uint8_t acked;
+  if(!RFM_txActive || RFM_txWait) return;
+  RFM_txActive = 0;
+  if(!RFM_txCount || !(RFM_reg[REG_CONFIG] & 0x02)) return;     // flushed or powered down
+  RFM_txNoAck = RFM_tx[0].pipe || !(RFM_reg[REG_EN_AA] & 0x01);
+  RFM_txWait  = 1;
+  acked = RFM_transmit(RFM_reg[REG_RF_CH], RFM_rate(), RFM_addr[2],
+                       RFM_tx[0].data, RFM_tx[0].len, RFM_txNoAck);
+  if(acked != RFM_TX_PENDING)
+    RFM_txResult(acked, acked ? 0 : RFM_reg[REG_SETUP_RETR] & 0x0F);
+}
+
+// Outcome of the transmission started by RFM_transmit()
+void RFM_txResult(uint8_t acked, uint8_t retransmits) {
+  if(!RFM_txWait) return;                         // TX FIFO flushed meanwhile
+  RFM_txWait = 0;
+  RFM_sent++;
+  RFM_reg[REG_OBSERVE_TX] = (RFM_reg[REG_OBSERVE_TX] & 0xF0) | (retransmits & 0x0F);
+  if(RFM_txNoAck || acked) {                      // sent (and ACK received)
+    if(!RFM_txNoAck) RFM_acked++;
+    RFM_reg[REG_STATUS] |= ST_TX_DS;
+    RFM_pop(RFM_tx, &RFM_txCount);
+    RFM_checkTX();                                // more in TX FIFO?
+  }
+  else {                                          // no ACK after all retransmits
+    if((RFM_reg[REG_OBSERVE_TX] & 0xF0) != 0xF0) RFM_reg[REG_OBSERVE_TX] += 0x10;
+    RFM_reg[REG_STATUS] |= ST_MAX_RT;             // payload stays in TX FIFO
+  }
+}
+
+// Packet on the air for this radio
+uint8_t RFM_receive(uint8_t ch, uint8_t rate, const uint8_t *addr,
+                    const uint8_t *buf, uint8_t len, uint8_t noack) {
+  uint8_t pipe;
+  uint8_t size = len;                             // number of bytes on the air
+  rfm_fifo_t *entry;
+  if(!RFM_listening() || (ch != RFM_reg[REG_RF_CH]) || (rate != RFM_rate()))
+    return RFM_RX_IGNORED;
+
+  // Find enabled pipe with matching address (pipes 2-5 share the upper bytes of P1)
+  for(pipe = 0; pipe < 6; pipe++) {
+    if(!(RFM_reg[REG_EN_RXADDR] & (1 << pipe))) continue;
+    if(pipe < 2) {
+      if(!memcmp(addr, RFM_addr[pipe], 5)) break;
+    }
+    else if((addr[0] == RFM_reg[REG_RX_ADDR_P1 + pipe - 1])
+            && !memcmp(addr + 1, RFM_addr[1] + 1, 4)) break;
+  }
+  if(pipe == 6) return RFM_RX_IGNORED;
+
+  // Static payload length if dynamic payload is not enabled for this pipe
+  if(!((RFM_reg[REG_FEATURE] & 0x04) && (RFM_reg[REG_DYNPD] & (1 << pipe)))) {
+    if(!RFM_reg[REG_RX_PW_P0 + pipe]) return RFM_RX_IGNORED;
+    len = RFM_reg[REG_RX_PW_P0 + pipe];
+  }
+  if(len > 32) len = 32;
+  if(size > len) size = len;
+
+  if(RFM_rxCount == 3) {
+    RFM_lost++;
+    return RFM_RX_LOST;
+  }
+  entry = &RFM_rx[RFM_rxCount++];
+  entry->pipe = pipe;
+  entry->len  = len;
+  memset(entry->data, 0, 32);
+  memcpy(entry->data, buf, size);
+  RFM_reg[REG_STATUS] |= ST_RX_DR;
+  RFM_received++;
+  if(noack || !(RFM_reg[REG_EN_AA] & (1 << pipe))) return RFM_RX_OK;
+  return RFM_RX_ACK;                              // receiver sends the ACK packet
+}
+
+// Current RF channel
+uint8_t RFM_channel(void) {
+  return RFM_reg[REG_RF_CH];
+}
+
+// Data rate: 0: 250kbps, 1: 1Mbps, 2: 2Mbps
+uint8_t RFM_rate(void) {
+  if(RFM_reg[REG_RF_SETUP] & 0x20) return 0;
+  if(RFM_reg[REG_RF_SETUP] & 0x08) return 2;
+  return 1;
+}
+
+// Current value of a register (no side effects)
+uint8_t RFM_register(uint8_t reg) {
+  return RFM_readReg(reg, 0);
+}
+
+// In RX mode with CE high
+uint8_t RFM_listening(void) {
+  return RFM_ce && ((RFM_reg[REG_CONFIG] & 0x03) == 0x03);
+}
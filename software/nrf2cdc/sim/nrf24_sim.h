@@ -0,0 +1,66 @@
+// ===================================================================================
+// nRF24L01+ Register and FIFO Model for the Host Simulation                  * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// RFM_reset()              power-on reset of all registers and FIFOs
+// RFM_select(csn)          CSN pin changed (low: start, high: end of transaction)
+// RFM_exchange(mosi)       clock one SPI byte, returns MISO byte
+// RFM_enable(ce)           CE pin changed
+// RFM_irq()                get IRQ pin level (0: active)
+// RFM_tick()               advance one millisecond: start pending transmission
+// RFM_txResult(ack,rt)     outcome of a transmission RFM_transmit() left pending
+// RFM_receive(...)         packet on the air for this radio, returns result (below)
+// RFM_channel()            current RF channel
+// RFM_rate()               current data rate (0: 250kbps, 1: 1Mbps, 2: 2Mbps)
+// RFM_register(reg)        current value of a register
+//
+// The model covers the register map, the 3-level RX and TX FIFOs, dynamic and static
+// payload lengths, the status flags with their IRQ masks and auto-ACK with
+// retransmits. A transmission starts on a tick; its outcome is decided by
+// RFM_transmit(), which has to be provided by the simulator (the "air"). It either
+// returns the outcome right away or RFM_TX_PENDING and reports it later with
+// RFM_txResult() (the multi-node medium in air.c does, after air time and
+// retransmits). Timing details (130us settling, air time, retransmit delay) are up
+// to the air.
+
+#pragma once
+#include <stdint.h>
+
+// Results of RFM_receive()
+#define RFM_RX_OK           0         // payload placed in RX FIFO
+#define RFM_RX_IGNORED      1         // not listening, other channel, rate or address
+#define RFM_RX_LOST         2         // RX FIFO full
+#define RFM_RX_ACK          3         // payload placed in RX FIFO and acknowledged
+
+// RFM_transmit() result: outcome follows with RFM_txResult()
+#define RFM_TX_PENDING      0xFF
+
+// Statistics
+extern uint32_t RFM_transactions;     // SPI transactions (CSN low)
+extern uint32_t RFM_bytes;            // SPI bytes
+extern uint32_t RFM_sent;             // packets transmitted
+extern uint32_t RFM_acked;            // of which were acknowledged
+extern uint32_t RFM_received;         // packets placed in RX FIFO
+extern uint32_t RFM_lost;             // packets lost (RX FIFO full)
+
+// Model functions
+void    RFM_reset(void);
+void    RFM_select(uint8_t csn);
+uint8_t RFM_exchange(uint8_t mosi);
+void    RFM_enable(uint8_t ce);
+uint8_t RFM_irq(void);
+void    RFM_tick(void);
+void    RFM_txResult(uint8_t acked, uint8_t retransmits);
+uint8_t RFM_receive(uint8_t ch, uint8_t rate, const uint8_t *addr,
+                    const uint8_t *buf, uint8_t len, uint8_t noack);
+uint8_t RFM_channel(void);            // current RF channel
+uint8_t RFM_rate(void);               // current data rate
+uint8_t RFM_register(uint8_t reg);    // current register value
+uint8_t RFM_listening(void);          // in RX mode with CE high
+
+// Provided by the simulator: put packet on the air, return 1 if it was acknowledged,
+// 0 if not or RFM_TX_PENDING
+uint8_t RFM_transmit(uint8_t ch, uint8_t rate, const uint8_t *addr,
+                     const uint8_t *buf, uint8_t len, uint8_t noack);
@@ -0,0 +1,677 @@
+// ===================================================================================
+// Host-Native Simulation of NRF2CDC                                          * v1.0 *
+// ===================================================================================
+//
+// Runs the unmodified firmware (nrf2cdc.c and src/*.c, compiled with a host compiler
+// against sim.h) with modeled peripherals: nRF24L01+ behind SPI (nrf24_sim.c), USB
+// endpoints with a scripted host, data flash, timer2 and the GPIO interrupt of the
+// NRF IRQ pin. A periodic SIGALRM acts as the hardware: every signal advances the
+// simulated time by 1 ms, runs due scenario events, services the USB host and the
+// radio and calls the firmware's interrupt service routines (if enabled by EA and
+// the respective enable bit). The firmware's main() runs as the "foreground".
+//
+// Usage:   nrf2cdc_sim [-u us] [-f flashfile] [-a fd] [scenario]
+//          -u us           real time per simulated ms (default 200)
+//          -f flashfile    load data flash from file and save it at the end
+//          -a fd           run as a node of the virtual RF medium (air.c) on socket fd
+//          scenario        script file (default: stdin)
+//
+// Scenario lines (@ms: simulated time, # starts a comment):
+//   @<ms> host <text>      host sends text (C escapes \n \r \t \\ \xNN allowed)
+//   @<ms> break            host sends a BREAK
+//   @<ms> suspend          host suspends the bus
+//   @<ms> resume           host resumes the bus
+//   @<ms> air <addr> <text>  peer sends payload to 5-byte hex address (LSB first)
+//                          on the current channel of the device
+//   @<ms> ack on|off       peer acknowledges the device's transmissions or not
+//   @<ms> stats            print counters and per-packet figures
+//   @<ms> reset            reset counters
+//   @<ms> end              print counters and quit
+//
+// The trace goes to stdout, one line per event: the data received by the host per
+// USB packet (host<), sent by the host (host>), transmitted by the device (rf>) and
+// placed on the air by the peer (rf<). The counters show what a change to the hot
+// paths costs: SPI transactions and bytes, USB packets, main loop iterations (one
+// WDT_reset() per iteration; in total and those that did SPI, USB or flash I/O) and
+// data flash writes. Since the foreground runs at host speed and the ticks come from
+// a real-time signal, the total loop count depends on the host and varies between
+// runs; SPI, USB and flash figures are exact. Not modeled: USB enumeration (the
+// device starts configured), remote wakeup signalling and radio timing.
+//
+// Started by the medium (nrf2cdc_air, -a fd), the simulation doesn't use the signal
+// for time: ticks come from the medium in lockstep with the other nodes (see air.h).
+// The device asks for the next tick whenever a main loop iteration did no I/O or
+// after 8 busy iterations, so loop counts and all results are reproducible. The
+// signal only steps in if the foreground stops calling WDT_reset() (busy waiting).
+// Transmissions go to the medium, which decides their outcome after air time and
+// retransmits, and packets of the other nodes arrive as "rf<" events.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "../src/config.h"
+#include "../src/usb_handler.h"
+#include "nrf24_sim.h"
+#include "air.h"
+
+// Access the registers themselves instead of the hooks
+#undef SPI0_DATA
+#undef S0_FREE
+#undef ROM_ADDR_L
+#undef ROM_ADDR_H
+#undef ROM_DATA_L
+#undef ROM_CTRL
+#undef WDOG_COUNT
+#undef main
+
+// Firmware entry points
+void FW_main(void);
+void USB_ISR(void);
+void NRF_ISR(void);
+void TMR_ISR(void);
+
+// USB descriptors (usb_descr.c is left out, only SDCC accepts its string descriptors
+// using sizeof() on themselves; the simulated host doesn't enumerate anyway)
+__code USB_DEV_DESCR DevDescr;
+__code USB_CFG_DESCR_CDC CfgDescr;
+__code uint16_t LangDescr[1], ManufDescr[1], ProdDescr[1], SerDescr[1], InterfDescr[1];
+
+// Scenario events
+#define SIM_MAX_EVENTS      4096
+#define SIM_MAX_TEXT        512
+typedef struct {
+  uint32_t time;                              // simulated ms
+  char     cmd[8];                            // command
+  uint8_t  addr[5];                           // air: address
+  uint16_t len;                               // length of data
+  uint8_t  data[SIM_MAX_TEXT];                // host/air: data, ack: on/off
+} sim_event_t;
+
+static sim_event_t *SIM_event;                // scenario events
+static uint16_t SIM_events, SIM_next;         // number of events, next event
+
+// Hardware state
+static volatile uint32_t SIM_time;            // simulated ms
+static volatile sig_atomic_t SIM_busy;        // model access or hardware in progress
+static volatile sig_atomic_t SIM_pending;     // ticks waiting for SIM_busy to clear
+static uint16_t SIM_tmrPending;               // timer interrupts held back by ET2/EA
+static uint8_t  SIM_irqLast = 1;              // last NRF IRQ pin level
+static uint8_t  SIM_gpioFlag;                 // GPIO interrupt flag (IRQ falling edge)
+static volatile uint16_t SIM_spiData = 0xFF00;  // SPI0_DATA (upper byte 0: written)
+static volatile uint16_t SIM_romCtrlReg = 0xFF00; // ROM_CTRL (upper byte 0: written)
+static uint8_t  SIM_pins[16];                 // output pin levels
+static uint8_t  SIM_flash[128];               // data flash
+static uint8_t  SIM_host[8192];               // data sent by the host, not yet taken
+static uint16_t SIM_hostLen;
+static uint8_t  SIM_peerAck = 1;              // peer acknowledges transmissions
+static const char *SIM_flashFile;             // data flash image file
+static int      SIM_airFd = -1;               // socket to the medium (-a)
+static uint8_t  SIM_airLoops;                 // busy loop iterations since last tick
+static volatile sig_atomic_t SIM_stall;       // signals since last WDT_reset()
+static air_msg_t SIM_airTx;                   // transmission waiting for its outcome
+
+static void SIM_romCommand(void);
+
+// Counters
+static uint32_t SIM_active;                   // main loop iterations with I/O
+static uint32_t SIM_io;                       // I/O count at last iteration
+static uint32_t SIM_loops, SIM_usbIn, SIM_usbInBytes, SIM_usbOut, SIM_usbOutBytes;
+static uint32_t SIM_flashWrites;
+
+// ===================================================================================
+// Trace Output (also used from the signal handler, so no stdio buffering)
+// ===================================================================================
+
+static void SIM_print(const char *fmt, ...) {
+  char line[2048];
+  int len;
+  va_list ap;
+  va_start(ap, fmt);
+  len = vsnprintf(line, sizeof(line), fmt, ap);
+  va_end(ap);
+  if(len > (int)sizeof(line) - 1) len = sizeof(line) - 1;
+  if(write(STDOUT_FILENO, line, len) < 0) exit(1);
+}
+
+// Trace line with time stamp, tag and escaped data
+static void SIM_trace(const char *tag, const char *info, const uint8_t *buf, uint16_t len) {
+  char text[SIM_MAX_TEXT * 4 + 1];
+  char *ptr = text;
+  while(len--) {
+    uint8_t c = *buf++;
+    if     (c == '\n') ptr += sprintf(ptr, "\\n");
+    else if(c == '\r') ptr += sprintf(ptr, "\\r");
+    else if(c == '\\') ptr += sprintf(ptr, "\\\\");
+    else if((c < 0x20) || (c > 0x7E)) ptr += sprintf(ptr, "\\x%02X", c);
+    else *ptr++ = c;
+  }
+  *ptr = 0;
+  if(buf) SIM_print("%7lu  %-6s %s\"%s\"\n", (unsigned long)SIM_time, tag, info, text);
+  else    SIM_print("%7lu  %-6s %s\n", (unsigned long)SIM_time, tag, info);
+}
+
+// Print counters
+static void SIM_stats(void) {
+  uint32_t packets = RFM_sent + RFM_received;
+  SIM_print("%7lu  stats  loops %lu (%lu with I/O), SPI %lu transactions / %lu bytes, "
+            "USB in %lu / %lu bytes, USB out %lu / %lu bytes, flash writes %lu\n",
+            (unsigned long)SIM_time, (unsigned long)SIM_loops, (unsigned long)SIM_active,
+            (unsigned long)RFM_transactions, (unsigned long)RFM_bytes,
+            (unsigned long)SIM_usbIn, (unsigned long)SIM_usbInBytes,
+            (unsigned long)SIM_usbOut, (unsigned long)SIM_usbOutBytes,
+            (unsigned long)SIM_flashWrites);
+  SIM_print("%7lu  stats  radio sent %lu (acked %lu), received %lu, lost %lu\n",
+            (unsigned long)SIM_time, (unsigned long)RFM_sent, (unsigned long)RFM_acked,
+            (unsigned long)RFM_received, (unsigned long)RFM_lost);
+  if(packets)
+    SIM_print("%7lu  stats  per radio packet: %.1f SPI transactions, %.1f SPI bytes, "
+              "%.1f loop iterations with I/O\n", (unsigned long)SIM_time,
+              (double)RFM_transactions / packets, (double)RFM_bytes / packets,
+              (double)SIM_active / packets);
+}
+
+// Reset counters
+static void SIM_resetStats(void) {
+  SIM_loops = SIM_active = SIM_usbIn = SIM_usbInBytes = SIM_usbOut = SIM_usbOutBytes = 0;
+  SIM_flashWrites = 0;
+  RFM_transactions = RFM_bytes = RFM_sent = RFM_acked = RFM_received = RFM_lost = 0;
+}
+
+// Write data flash image and quit
+static void SIM_exit(int code) {
+  FILE *f;
+  SIM_romCommand();                             // last write may still be pending
+  if(SIM_flashFile && (f = fopen(SIM_flashFile, "wb"))) {
+    fwrite(SIM_flash, 1, sizeof(SIM_flash), f);
+    fclose(f);
+  }
+  exit(code);
+}
+
+// ===================================================================================
+// Medium Connection (-a)
+// ===================================================================================
+
+// Send message to the medium
+static void SIM_airPut(const air_msg_t *msg) {
+  while(write(SIM_airFd, msg, sizeof(air_msg_t)) != sizeof(air_msg_t))
+    if(errno != EINTR) SIM_exit(1);
+}
+
+// Wait for message from the medium, quit when the medium ends the run
+static void SIM_airGet(air_msg_t *msg) {
+  ssize_t len;
+  while((len = read(SIM_airFd, msg, sizeof(air_msg_t))) != sizeof(air_msg_t)) {
+    if((len < 0) && (errno == EINTR)) continue;
+    SIM_stats();
+    SIM_exit(0);
+  }
+}
+
+// ===================================================================================
+// USB Host Model
+// ===================================================================================
+
+// Signal a completed transfer to the firmware
+static void SIM_usbTransfer(uint8_t token) {
+  USB_INT_ST   = token;
+  UIF_TRANSFER = 1;
+  USB_ISR();
+}
+
+// Let the host take and deliver data on the endpoints
+static void SIM_usbService(void) {
+  uint8_t len;
+  char info[32];
+  if(!EA || !IE_USB) return;
+
+  // EP2 IN: bulk data to host
+  if((UEP2_CTRL & MASK_UEP_T_RES) == UEP_T_RES_ACK) {
+    SIM_trace("host<", "", EP2_buffer + 64, UEP2_T_LEN);
+    SIM_usbIn++;
+    SIM_usbInBytes += UEP2_T_LEN;
+    SIM_usbTransfer(UIS_TOKEN_IN | 2);
+  }
+
+  // EP1 IN: SERIAL_STATE notification
+  if((UEP1_CTRL & MASK_UEP_T_RES) == UEP_T_RES_ACK) {
+    sprintf(info, "state 0x%02X ", EP1_buffer[8]);
+    SIM_trace("notify", info, EP1_buffer, 0);
+    SIM_usbTransfer(UIS_TOKEN_IN | 1);
+  }
+
+  // EP2 OUT: bulk data from host
+  if(SIM_hostLen && ((UEP2_CTRL & MASK_UEP_R_RES) == UEP_R_RES_ACK)) {
+    len = (SIM_hostLen > EP2_SIZE) ? EP2_SIZE : SIM_hostLen;
+    memcpy(EP2_buffer, SIM_host, len);
+    memmove(SIM_host, SIM_host + len, SIM_hostLen - len);
+    SIM_hostLen -= len;
+    SIM_usbOut++;
+    SIM_usbOutBytes += len;
+    USB_RX_LEN = len;
+    U_TOG_OK   = 1;
+    SIM_usbTransfer(UIS_TOKEN_OUT | 2);
+  }
+}
+
+// Host sends a class request without data stage (e.g. SEND_BREAK)
+static void SIM_usbClassRequest(uint8_t request, uint16_t value) {
+  static const uint8_t setup[8] = {0x21, 0, 0, 0, 0, 0, 0, 0};
+  memcpy(EP0_buffer, setup, 8);
+  EP0_buffer[1] = request;
+  EP0_buffer[2] = value;
+  EP0_buffer[3] = value >> 8;
+  USB_RX_LEN = 8;
+  SIM_usbTransfer(UIS_TOKEN_SETUP);
+  SIM_usbTransfer(UIS_TOKEN_IN);                // status stage
+}
+
+// Host suspends or resumes the bus
+static void SIM_usbSuspend(uint8_t suspend) {
+  if(suspend) USB_MIS_ST |=  bUMS_SUSPEND;
+  else        USB_MIS_ST &= ~bUMS_SUSPEND;
+  UIF_SUSPEND = 1;
+  USB_ISR();
+}
+
+// ===================================================================================
+// Air (single peer controlled by the scenario)
+// ===================================================================================
+
+// Trace a transmission of the device
+static void SIM_airTrace(const air_msg_t *tx, const char *result) {
+  static const char *RATE[] = {"250k", "1M", "2M"};
+  char info[80];
+  sprintf(info, "ch %02X %s to %02X%02X%02X%02X%02X %s ", tx->ch, RATE[tx->rate],
+          tx->addr[0], tx->addr[1], tx->addr[2], tx->addr[3], tx->addr[4], result);
+  SIM_trace("rf>", info, tx->data, tx->len);
+}
+
+// The device transmits a packet
+uint8_t RFM_transmit(uint8_t ch, uint8_t rate, const uint8_t *addr,
+                     const uint8_t *buf, uint8_t len, uint8_t noack) {
+  air_msg_t *tx = &SIM_airTx;
+  tx->type  = AIR_TX;
+  tx->ch    = ch;
+  tx->rate  = rate;
+  tx->noack = noack;
+  tx->retr  = RFM_register(0x04);             // SETUP_RETR
+  tx->len   = len;
+  memcpy(tx->addr, addr, 5);
+  memcpy(tx->data, buf, len);
+  if(SIM_airFd >= 0) {                        // medium decides, see SIM_airStep()
+    SIM_airPut(tx);
+    return RFM_TX_PENDING;
+  }
+  SIM_airTrace(tx, noack ? "no-ack" : (SIM_peerAck ? "acked" : "failed"));
+  return SIM_peerAck;
+}
+
+// A packet on the air reaches the device
+static uint8_t SIM_airReceive(uint8_t ch, uint8_t rate, const uint8_t *addr,
+                              const uint8_t *buf, uint8_t len, uint8_t noack) {
+  static const char *RESULT[] = {"", "ignored ", "lost ", "acked "};
+  char info[64];
+  uint8_t result = RFM_receive(ch, rate, addr, buf, len, noack);
+  sprintf(info, "to %02X%02X%02X%02X%02X %s", addr[0], addr[1], addr[2], addr[3],
+          addr[4], RESULT[result]);
+  SIM_trace("rf<", info, buf, len);
+  return result;
+}
+
+// The peer transmits a packet on the current channel and data rate of the device
+static void SIM_airSend(const uint8_t *addr, const uint8_t *buf, uint8_t len) {
+  SIM_airReceive(RFM_channel(), RFM_rate(), addr, buf, len, 0);
+}
+
+// ===================================================================================
+// Hardware Tick (1 ms)
+// ===================================================================================
+
+// Latch falling edge of the NRF IRQ pin for the GPIO interrupt
+static void SIM_checkIRQ(void) {
+  uint8_t irq = RFM_irq();
+  if(SIM_irqLast && !irq) SIM_gpioFlag = 1;
+  SIM_irqLast = irq;
+}
+
+// Run due scenario events
+static void SIM_runEvents(void) {
+  sim_event_t *ev;
+  while((SIM_next < SIM_events) && (SIM_event[SIM_next].time <= SIM_time)) {
+    ev = &SIM_event[SIM_next++];
+    if(!strcmp(ev->cmd, "host")) {
+      if(SIM_hostLen + ev->len > sizeof(SIM_host)) SIM_print("host buffer overflow\n");
+      else {
+        memcpy(SIM_host + SIM_hostLen, ev->data, ev->len);
+        SIM_hostLen += ev->len;
+        SIM_trace("host>", "", ev->data, ev->len);
+      }
+    }
+    else if(!strcmp(ev->cmd, "air"))     SIM_airSend(ev->addr, ev->data, ev->len);
+    else if(!strcmp(ev->cmd, "ack"))     SIM_peerAck = ev->data[0];
+    else if(!strcmp(ev->cmd, "break")) {
+      SIM_trace("usb", "break", NULL, 0);
+      SIM_usbClassRequest(0x23, 0xFFFF);
+    }
+    else if(!strcmp(ev->cmd, "suspend")) {
+      SIM_trace("usb", "suspend", NULL, 0);
+      SIM_usbSuspend(1);
+    }
+    else if(!strcmp(ev->cmd, "resume")) {
+      SIM_trace("usb", "resume", NULL, 0);
+      SIM_usbSuspend(0);
+    }
+    else if(!strcmp(ev->cmd, "stats"))   SIM_stats();
+    else if(!strcmp(ev->cmd, "reset"))   SIM_resetStats();
+    else if(!strcmp(ev->cmd, "end")) {
+      SIM_stats();
+      SIM_exit(0);
+    }
+  }
+}
+
+// GPIO interrupt on a falling edge of the NRF IRQ pin
+static void SIM_irqService(void) {
+  SIM_checkIRQ();
+  if(SIM_gpioFlag && EA && IE_GPIO && (GPIO_IE & bIE_P3_1_LO)) {
+    SIM_gpioFlag = 0;
+    NRF_ISR();
+  }
+}
+
+// Advance simulated time by 1 ms
+static void SIM_tick(void) {
+  SIM_time++;
+  SIM_runEvents();
+
+  // Timer2 interrupt
+  SIM_tmrPending++;
+  while(SIM_tmrPending && EA && ET2) {
+    SIM_tmrPending--;
+    TMR_ISR();
+  }
+
+  // Radio and GPIO interrupt of the IRQ pin
+  RFM_tick();
+  SIM_irqService();
+
+  // USB
+  SIM_usbService();
+}
+
+// Medium mode: report the foreground idle, then run the next tick in lockstep
+static void SIM_airStep(void) {
+  air_msg_t msg;
+  SIM_stall = 0;
+  msg.type  = AIR_DONE;
+  SIM_airPut(&msg);
+  do SIM_airGet(&msg); while(msg.type != AIR_TICK);
+  SIM_tick();                                   // transmission goes out as AIR_TX
+  msg.type = AIR_SENT;
+  SIM_airPut(&msg);
+  for(;;) {
+    SIM_airGet(&msg);
+    if(msg.type == AIR_PACKET) {
+      msg.result = SIM_airReceive(msg.ch, msg.rate, msg.addr, msg.data, msg.len,
+                                  msg.noack);
+      msg.type   = AIR_RECEIVED;
+      SIM_airPut(&msg);
+    }
+    else if(msg.type == AIR_RESULT) {
+      char info[32];
+      if(SIM_airTx.noack) strcpy(info, "no-ack");
+      else sprintf(info, "%s %u", msg.result ? "acked" : "failed", msg.retr);
+      SIM_airTrace(&SIM_airTx, info);
+      RFM_txResult(msg.result, msg.retr);
+    }
+    else if(msg.type == AIR_END) break;
+  }
+  SIM_irqService();
+}
+
+// Run pending ticks (not while the foreground is inside a model)
+static void SIM_run(void) {
+  SIM_busy++;
+  while(SIM_pending) {
+    SIM_pending--;
+    SIM_tick();
+  }
+  SIM_busy--;
+}
+
+// SIGALRM handler
+static void SIM_signal(int sig) {
+  (void)sig;
+  if(SIM_airFd >= 0) {                          // medium mode: foreground hangs?
+    if(!SIM_busy && (++SIM_stall > 2)) {
+      SIM_busy++;
+      SIM_airStep();
+      SIM_busy--;
+    }
+    return;
+  }
+  SIM_pending++;
+  if(!SIM_busy) SIM_run();
+}
+
+// Enter and leave a model from the foreground
+static void SIM_enter(void) {
+  SIM_busy++;
+}
+
+static void SIM_leave(void) {
+  if((--SIM_busy == 0) && SIM_pending) SIM_run();
+}
+
+// ===================================================================================
+// Register and Pin Hooks (called by the firmware via sim.h)
+// ===================================================================================
+
+// SPI0_DATA accessed: a write starts a transfer, which is finished at S0_FREE
+volatile uint16_t* SIM_spi(void) {
+  return &SIM_spiData;
+}
+
+// S0_FREE polled: exchange the byte written to SPI0_DATA with the NRF
+uint8_t SIM_spiFree(void) {
+  if(!(SIM_spiData & 0xFF00)) {
+    SIM_enter();
+    SIM_spiData = 0xFF00 | RFM_exchange(SIM_spiData);
+    SIM_leave();
+  }
+  return 1;
+}
+
+// Execute the data flash command written to ROM_CTRL before
+static void SIM_romCommand(void) {
+  uint8_t addr = (ROM_ADDR_L >> 1) & 0x7F;
+  if(SIM_romCtrlReg & 0xFF00) return;           // no new command
+  if(SIM_romCtrlReg == ROM_CMD_READ) ROM_DATA_L = SIM_flash[addr];
+  else if(SIM_romCtrlReg == ROM_CMD_WRITE) {
+    SIM_flash[addr] = ROM_DATA_L;
+    SIM_flashWrites++;
+  }
+  SIM_romCtrlReg = 0xFF00 | bROM_ADDR_OK;       // status: address valid
+}
+
+// Data flash address or data register accessed
+volatile uint8_t* SIM_rom(volatile uint8_t *reg) {
+  SIM_romCommand();                             // finish previous command first
+  return reg;
+}
+
+// ROM_CTRL (write: command, read: ROM_STATUS) accessed
+volatile uint16_t* SIM_romCtrl(void) {
+  SIM_romCommand();
+  return &SIM_romCtrlReg;
+}
+
+// Watchdog counter accessed (once per main loop iteration): also service USB
+volatile uint8_t* SIM_wdog(volatile uint8_t *reg) {
+  uint32_t io = RFM_bytes + SIM_usbInBytes + SIM_usbOutBytes + SIM_flashWrites;
+  SIM_loops++;
+  if(io != SIM_io) SIM_active++;                // iteration did SPI, USB or flash I/O
+  SIM_stall = 0;
+  SIM_enter();
+  SIM_usbService();
+  if((SIM_airFd >= 0) && ((io == SIM_io) || (++SIM_airLoops >= 8))) {
+    SIM_airLoops = 0;
+    SIM_airStep();                              // idle or busy for long: next tick
+  }
+  SIM_leave();
+  SIM_io = RFM_bytes + SIM_usbInBytes + SIM_usbOutBytes + SIM_flashWrites;
+  return reg;
+}
+
+// Output pin set
+void SIM_pinWrite(uint8_t pin, uint8_t val) {
+  val = !!val;
+  if(SIM_pins[pin] == val) return;
+  SIM_pins[pin] = val;
+  SIM_enter();
+  if(pin == PIN_CSN) {
+    RFM_select(val);
+    SIM_checkIRQ();
+  }
+  else if(pin == PIN_CE) RFM_enable(val);
+  SIM_leave();
+}
+
+// Pin read
+uint8_t SIM_pinRead(uint8_t pin) {
+  if(pin == PIN_IRQ) return RFM_irq();
+  return SIM_pins[pin];
+}
+
+// ===================================================================================
+// Scenario Parser
+// ===================================================================================
+
+// Convert text with C escapes, return length
+static uint16_t SIM_unescape(const char *src, uint8_t *dst) {
+  uint16_t len = 0;
+  unsigned int val;
+  while(*src && (len < SIM_MAX_TEXT)) {
+    if(*src != '\\') {
+      dst[len++] = *src++;
+      continue;
+    }
+    src++;
+    switch(*src) {
+      case 'n':  dst[len++] = '\n'; src++; break;
+      case 'r':  dst[len++] = '\r'; src++; break;
+      case 't':  dst[len++] = '\t'; src++; break;
+      case 'x':
+        if(sscanf(src + 1, "%2x", &val) == 1) {
+          dst[len++] = val;
+          src += 3;
+        }
+        else src++;
+        break;
+      case 0:    break;
+      default:   dst[len++] = *src++; break;
+    }
+  }
+  return len;
+}
+
+// Read scenario file
+static void SIM_load(FILE *f) {
+  char line[SIM_MAX_TEXT * 4];
+  char *ptr, *arg;
+  unsigned long time;
+  unsigned int a[5];
+  uint16_t lineno = 0;
+  sim_event_t *ev;
+
+  SIM_event = calloc(SIM_MAX_EVENTS, sizeof(sim_event_t));
+  if(!SIM_event) exit(1);
+  while(fgets(line, sizeof(line), f)) {
+    lineno++;
+    line[strcspn(line, "\r\n")] = 0;
+    ptr = line + strspn(line, " \t");
+    if(!*ptr || (*ptr == '#')) continue;
+    if((*ptr != '@') || (SIM_events == SIM_MAX_EVENTS)) goto error;
+    time = strtoul(ptr + 1, &ptr, 10);
+    ptr += strspn(ptr, " \t");
+    ev = &SIM_event[SIM_events++];
+    ev->time = time;
+    arg = ptr + strcspn(ptr, " \t");
+    if((arg - ptr) >= (int)sizeof(ev->cmd)) goto error;
+    memcpy(ev->cmd, ptr, arg - ptr);
+    if(*arg) arg++;
+
+    if(!strcmp(ev->cmd, "host")) ev->len = SIM_unescape(arg, ev->data);
+    else if(!strcmp(ev->cmd, "air")) {
+      if(sscanf(arg, "%2x%2x%2x%2x%2x", &a[0], &a[1], &a[2], &a[3], &a[4]) != 5)
+        goto error;
+      for(int i=0; i<5; i++) ev->addr[i] = a[i];
+      arg += strcspn(arg, " \t");
+      if(*arg) arg++;
+      ev->len = SIM_unescape(arg, ev->data);
+      if(ev->len > 32) goto error;
+    }
+    else if(!strcmp(ev->cmd, "ack")) ev->data[0] = !strcmp(arg, "on");
+    else if(strcmp(ev->cmd, "break") && strcmp(ev->cmd, "suspend")
+         && strcmp(ev->cmd, "resume") && strcmp(ev->cmd, "stats")
+         && strcmp(ev->cmd, "reset") && strcmp(ev->cmd, "end")) goto error;
+  }
+  return;
+
+  error:
+  fprintf(stderr, "scenario line %u: invalid: %s\n", lineno, line);
+  exit(1);
+}
+
+// ===================================================================================
+// Main Function
+// ===================================================================================
+int main(int argc, char **argv) {
+  struct itimerval timer;
+  long usPerTick = 200;
+  FILE *f = stdin;
+  int opt;
+
+  while((opt = getopt(argc, argv, "u:f:a:")) != -1) {
+    switch(opt) {
+      case 'u': usPerTick = atol(optarg); break;
+      case 'f': SIM_flashFile = optarg; break;
+      case 'a': SIM_airFd = atoi(optarg); usPerTick = 1000; break;
+      default:
+        fprintf(stderr, "usage: %s [-u us] [-f flashfile] [-a fd] [scenario]\n",
+                argv[0]);
+        return 1;
+    }
+  }
+  if((optind < argc) && !(f = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+  SIM_load(f);
+  if(f != stdin) fclose(f);
+
+  // Power-on state
+  memset(SIM_flash, 0xFF, sizeof(SIM_flash));
+  if(SIM_flashFile && (f = fopen(SIM_flashFile, "rb"))) {
+    if(fread(SIM_flash, 1, sizeof(SIM_flash), f) != sizeof(SIM_flash))
+      memset(SIM_flash, 0xFF, sizeof(SIM_flash));
+    fclose(f);
+  }
+  RFM_reset();
+  SIM_pins[PIN_CSN] = 1;
+
+  // Start hardware ticks and firmware
+  signal(SIGALRM, SIM_signal);
+  timer.it_interval.tv_sec  = 0;
+  timer.it_interval.tv_usec = usPerTick;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_REAL, &timer, NULL);
+  FW_main();
+  return 0;
+}
@@ -0,0 +1,83 @@
+// ===================================================================================
+// Host-Native Simulation Layer for NRF2CDC                                   * v1.0 *
+// ===================================================================================
+//
+// This header is force-included (gcc -include) into every source file of the host
+// simulation build ('make sim'). It maps the SDCC keywords to plain C and includes
+// the CH55x register definitions, so every SFR becomes an ordinary variable. The
+// registers and pins with side effects are then redirected to the peripheral models:
+//
+// SPI0_DATA, S0_FREE       SPI master with the nRF24L01+ model (nrf24_sim.c)
+// ROM_ADDR_x, ROM_DATA_L,  data flash (128 bytes)
+// ROM_CTRL, ROM_STATUS
+// WDOG_COUNT               counts main loop iterations (one WDT_reset() per loop)
+// PIN_low(), PIN_high(),   CSN, CE, IRQ and LED pins
+// PIN_read(), ...
+//
+// SPI0_DATA and ROM_CTRL are 16-bit stand-ins: the model sets the upper byte on
+// every read access, so a cleared upper byte tells that the firmware wrote to it.
+// The other redirecting macros refer to the register variable by their own name,
+// which the preprocessor doesn't expand again. Everything else (USB endpoint registers,
+// interrupt enables, ...) stays a plain variable and is checked by the USB model on
+// every simulated millisecond and main loop iteration. The firmware's main() is
+// renamed to FW_main() and run by the simulator (sim.c).
+
+#pragma once
+#include <stdint.h>
+
+#define SIM_HOST                          // host simulation build
+
+// SDCC keywords and storage classes
+#define __xdata
+#define __data
+#define __idata
+#define __pdata
+#define __code          const
+#define __bit           uint8_t
+#define __sbit          volatile uint8_t
+#define __sfr           volatile uint8_t
+#define __sfr16         volatile uint16_t
+#define __sfr32         volatile uint32_t
+#define __at(x)
+#define __interrupt(x)
+#define __using(x)
+#define __reentrant
+#define __critical
+#define __naked
+#define __asm__(x)
+#define inline          static inline
+#define main            FW_main
+
+// Register definitions (SFRs become variables)
+#include "../src/ch554.h"
+#include "../src/gpio.h"
+
+// Peripheral model hooks
+volatile uint16_t* SIM_spi(void);                    // access SPI0_DATA
+uint8_t SIM_spiFree(void);                            // finish SPI transfer
+volatile uint8_t* SIM_rom(volatile uint8_t *reg);     // access data flash registers
+volatile uint16_t* SIM_romCtrl(void);                 // access ROM_CTRL/ROM_STATUS
+volatile uint8_t* SIM_wdog(volatile uint8_t *reg);    // access watchdog counter
+void    SIM_pinWrite(uint8_t pin, uint8_t val);       // set output pin
+uint8_t SIM_pinRead(uint8_t pin);                     // read pin
+
+// Registers with side effects
+#define SPI0_DATA       (*SIM_spi())
+#define S0_FREE         (SIM_spiFree())
+#define ROM_ADDR_L      (*SIM_rom(&ROM_ADDR_L))
+#define ROM_ADDR_H      (*SIM_rom(&ROM_ADDR_H))
+#define ROM_DATA_L      (*SIM_rom(&ROM_DATA_L))
+#define ROM_CTRL        (*SIM_romCtrl())
+#define WDOG_COUNT      (*SIM_wdog(&WDOG_COUNT))
+
+// Pins
+#undef  PIN_low
+#undef  PIN_high
+#undef  PIN_toggle
+#undef  PIN_read
+#undef  PIN_write
+#define PIN_low(PIN)          SIM_pinWrite(PIN, 0)
+#define PIN_high(PIN)         SIM_pinWrite(PIN, 1)
+#define PIN_toggle(PIN)       SIM_pinWrite(PIN, !SIM_pinRead(PIN))
+#define PIN_read(PIN)         SIM_pinRead(PIN)
+#define PIN_write(PIN, val)   SIM_pinWrite(PIN, val)
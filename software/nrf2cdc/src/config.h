@@ -16,8 +16,63 @@
 // USB2NRF Settings
 #define NRF_PAYLOAD         32        // NRF max payload (1-32)
 #define NRF_CONFIG          0x0C      // CRC scheme, 0x08:8bit, 0x0C:16bit
-#define FLASH_IDENT         0xA96C    // to identify if data flash was written
+#define FLASH_IDENT         0xA96C    // to identify settings in old data flash layout
+#define NRF_PROFILES        4         // number of stored radio profiles
+#define JRN_KEYS            (2 + NRF_PROFILES) // number of record keys in journal (max 7)
+#define FLASH_DELAY         3000      // save changed settings after ms without changes
 #define CMD_IDENT           '!'       // command string identifier
+#define RAW_TIMEOUT         5         // raw mode: send incomplete packet after idle ms
+#define WAKE_DELAY          5         // min ms of suspend before remote wakeup (USB: 5)
+#define DST_TABLE_SIZE      15        // number of destination addresses (max 15)
+
+// Firmware variant: the full interactive firmware is built by default. 'make
+// VARIANT=raw' or 'make VARIANT=sniffer' (or defining VARIANT_RAW or VARIANT_SNIFFER
+// here) builds a specialized firmware: code for the modes it doesn't have is left
+// out and the mode checks on the data paths are resolved at compile time.
+#if defined(VARIANT_RAW)              // raw stream bridge, commands after a BREAK
+  #define FEATURE_TX        1         // send data from the host via NRF
+  #define FEATURE_TEXT      0         // text mode payloads ("Sent"/"Read" reports)
+  #define FEATURE_HEX       0         // hex mode (option X)
+  #define FEATURE_BINARY    0         // binary mode (option B)
+  #define FEATURE_RAW       1         // raw stream mode (option R)
+  #define TX_QUEUE_SIZE     8         // number of packets in TX queue
+#elif defined(VARIANT_SNIFFER)        // receive only, payloads as text or hex lines
+  #define FEATURE_TX        0
+  #define FEATURE_TEXT      1
+  #define FEATURE_HEX       1
+  #define FEATURE_BINARY    0
+  #define FEATURE_RAW       0
+  #define TX_QUEUE_SIZE     0
+#else                                 // full interactive firmware
+  #define FEATURE_TX        1
+  #define FEATURE_TEXT      1
+  #define FEATURE_HEX       1
+  #define FEATURE_BINARY    1
+  #define FEATURE_RAW       1
+  #define TX_QUEUE_SIZE     4
+#endif
+
+// Packet pool: a block for each TX queue slot plus one for the packet being filled
+#if TX_QUEUE_SIZE
+  #define POOL_BLOCKS       (TX_QUEUE_SIZE + 1) // number of 32-byte packet blocks
+#else
+  #define POOL_BLOCKS       0
+#endif
+
+// Software timers
+#define TMR_TIMERS          3         // number of software timers (max 8)
+#define TMR_NRF             0         // NRF start-up time after power down
+#define TMR_FLASH           1         // delay before saving changed settings
+#define TMR_RAW             2         // raw mode idle timeout
+
+// Tasks in order of priority (see src/task.h)
+#define TASKS               5         // number of tasks (max 8)
+#define TASK_RADIO          0         // finish and start transmissions, drain RX FIFO
+#define TASK_USB_OUT        1         // data from the host into the TX queue
+#define TASK_USB_IN         2         // event notifications to the host
+#define TASK_COMMAND        3         // parse command line from the host
+#define TASK_HOUSEKEEPING   4         // break, suspend, saving settings, LED
+#define TASK_STATS          1         // record runs and max run time of each task
 
 // USB device descriptor
 #define USB_VENDOR_ID       0x16C0    // VID (shared www.voti.nl)
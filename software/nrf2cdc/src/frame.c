@@ -0,0 +1,114 @@
+// ===================================================================================
+// Framed Binary Protocol with COBS Encoding                                  * v1.0 *
+// ===================================================================================
+
+#include "frame.h"
+#include "usb_cdc.h"
+
+#if FEATURE_BINARY                          // left out in variants without binary mode
+
+// ===================================================================================
+// Variables
+// ===================================================================================
+__xdata uint8_t FRAME_buffer[FRAME_SIZE];   // decoded frame (header + payload)
+uint8_t FRAME_rxPointer = 0;                // number of decoded bytes
+uint8_t FRAME_rxCode    = 0xFF;             // code byte of current block
+uint8_t FRAME_rxCount   = 0;                // remaining data bytes in current block
+__bit FRAME_rxTrunc = 0;                    // frame overflow, rest is discarded
+__xdata uint8_t *FRAME_txPointer;           // start of frame reserved in CDC buffer
+
+// ===================================================================================
+// Frame Encoder
+// ===================================================================================
+
+// Get byte at index of the virtual sequence header + payload
+#define FRAME_byte(i)   ((i) ? buf[(i)-1] : hdr)
+
+// COBS-encode header + payload and write frame via CDC (max payload 253 bytes)
+void FRAME_send(uint8_t hdr, __xdata uint8_t *buf, uint8_t len) {
+  uint8_t start = 0;                        // start index of current block
+  uint8_t end;                              // end index of current block
+  len++;                                    // total length including header
+  do {
+    end = start;
+    while((end < len) && FRAME_byte(end)) end++;  // search next zero or end
+    CDC_write(end - start + 1);             // write code byte
+    while(start < end) {                    // write data bytes of block
+      CDC_write(FRAME_byte(start));
+      start++;
+    }
+    start++;                                // skip the zero
+  } while(start <= len);
+  CDC_write(0);                             // write frame delimiter
+  CDC_flush();                              // flush OUT buffer
+}
+
+// Reserve space for a frame with len payload bytes (max 61) in CDC OUT buffer,
+// return pointer to where the payload has to be written
+__xdata uint8_t* FRAME_reserve(uint8_t len) {
+  FRAME_txPointer = CDC_reserve(len + 3);   // code byte + header + payload + delimiter
+  return FRAME_txPointer + 2;               // payload behind code byte and header
+}
+
+// COBS-encode reserved frame with header and len payload bytes in place and append
+// it to the CDC OUT buffer (every zero is replaced by the distance to the next one)
+void FRAME_commit(uint8_t hdr, uint8_t len) {
+  __xdata uint8_t *code = FRAME_txPointer;  // position of current code byte
+  __xdata uint8_t *ptr  = code + 1;         // position of current data byte
+  uint8_t cnt = len + 1;                    // header + payload
+  uint8_t dist = 1;                         // distance to current code byte
+  *ptr = hdr;                               // patch in header
+  while(cnt--) {
+    if(*ptr) dist++;                        // data byte -> belongs to current block
+    else {                                  // zero -> ends current block:
+      *code = dist;                         // patch in code byte of current block
+      code  = ptr;                          // zero becomes code byte of next block
+      dist  = 1;
+    }
+    ptr++;
+  }
+  *code = dist;                             // patch in code byte of last block
+  *ptr  = 0;                                // frame delimiter
+  CDC_commit(len + 3);                      // append frame to OUT buffer
+}
+
+// ===================================================================================
+// Frame Decoder
+// ===================================================================================
+
+// Feed received byte into decoder, return length of completed frame, FRAME_TRUNCATED
+// if it didn't fit into FRAME_buffer (the beginning is kept) or 0
+uint8_t FRAME_receive(uint8_t c) {
+  uint8_t len;
+
+  // Frame delimiter
+  if(!c) {
+    len = FRAME_rxPointer;
+    if(FRAME_rxTrunc) len = FRAME_TRUNCATED;      // overflow -> report truncated
+    if(FRAME_rxCount) len = 0;              // incomplete -> discard
+    FRAME_rxPointer = 0;                    // reset decoder
+    FRAME_rxCode    = 0xFF;
+    FRAME_rxCount   = 0;
+    FRAME_rxTrunc   = 0;
+    return len;
+  }
+
+  // Code byte: append zero implied by previous block
+  if(!FRAME_rxCount) {
+    if(FRAME_rxCode != 0xFF) {
+      if(FRAME_rxPointer == FRAME_SIZE) FRAME_rxTrunc = 1;
+      else FRAME_buffer[FRAME_rxPointer++] = 0;
+    }
+    FRAME_rxCode  = c;
+    FRAME_rxCount = c - 1;
+    return 0;
+  }
+
+  // Data byte
+  if(FRAME_rxPointer == FRAME_SIZE) FRAME_rxTrunc = 1;
+  else FRAME_buffer[FRAME_rxPointer++] = c;
+  FRAME_rxCount--;
+  return 0;
+}
+
+#endif // FEATURE_BINARY
@@ -0,0 +1,61 @@
+// ===================================================================================
+// Framed Binary Protocol with COBS Encoding                                  * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// FRAME_send(hdr, buf, len)  COBS-encode header + payload and write frame via CDC
+// FRAME_reserve(len)        reserve space for a frame with len payload bytes in the
+//                            CDC OUT buffer, returns pointer for the payload
+// FRAME_commit(hdr, len)     COBS-encode reserved frame in place and append it
+// FRAME_receive(c)           feed received byte into decoder, returns length of
+//                            completed frame (header + payload), FRAME_TRUNCATED
+//                            if it was too long for FRAME_buffer, or 0
+//
+// Every frame consists of a header byte (upper nibble: frame type, lower nibble:
+// pipe number) followed by the payload. The frame is COBS-encoded (Consistent
+// Overhead Byte Stuffing), so it contains no zero bytes, and terminated by a single
+// zero byte. The receiver can therefore always resynchronize at the next zero byte,
+// e.g. after a partial read. A decoded frame is placed in FRAME_buffer.
+//
+// FRAME_reserve() and FRAME_commit() build a frame directly inside the USB endpoint
+// buffer: the payload is written (e.g. by SPI) behind a placeholder for the code
+// byte and the header, which are patched in afterwards by encoding in place. This
+// avoids copying the payload and a function call per byte. Only for payloads up to
+// 61 bytes, since the whole frame must fit into one USB packet.
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+// Frame types (upper nibble of the header byte)
+#define FRAME_DATA          0x10      // radio payload (host <-> device)
+#define FRAME_ACK           0x20      // transmission report (device -> host)
+#define FRAME_STAT          0x30      // settings and status (device -> host)
+#define FRAME_CMD           0x40      // command string without '!' (host -> device)
+#define FRAME_SEND          0x50      // token + radio payload (host -> device)
+#define FRAME_DONE          0x60      // TX completion event (device -> host)
+#define FRAME_TYPE_MASK     0xF0      // mask for frame type
+#define FRAME_PIPE_MASK     0x0F      // mask for pipe number
+
+// Outcome of a transmission reported in TX completion events
+#define FRAME_TX_ACKED      0x00      // payload sent and ACK received
+#define FRAME_TX_FAILED     0x01      // no ACK after max number of retransmits
+#define FRAME_TX_NOACK      0x02      // payload sent, auto ACK disabled
+#define FRAME_TX_INVALID    0x03      // payload too long, not sent
+
+// Frame buffer size (header + token + max payload)
+#define FRAME_SIZE          (NRF_PAYLOAD + 2)
+
+// Return value of FRAME_receive() for a frame longer than FRAME_SIZE, only its first
+// FRAME_SIZE bytes are in FRAME_buffer (so header and token can still be read)
+#define FRAME_TRUNCATED     0xFF
+
+// Frame variables
+extern __xdata uint8_t FRAME_buffer[];                  // decoded frame
+
+// Frame functions
+void FRAME_send(uint8_t hdr, __xdata uint8_t *buf, uint8_t len);  // write frame via CDC
+__xdata uint8_t* FRAME_reserve(uint8_t len);           // reserve frame in CDC buffer
+void FRAME_commit(uint8_t hdr, uint8_t len);            // encode and append frame
+uint8_t FRAME_receive(uint8_t c);                       // feed byte into decoder
@@ -0,0 +1,134 @@
+// ===================================================================================
+// Wear-Leveling Settings Journal in Data Flash                               * v1.0 *
+// ===================================================================================
+
+#include "journal.h"
+#include "flash.h"
+
+// Records older than this number of writes are moved along
+#define JRN_MAX_AGE     64
+
+// Slot marker for keys without record
+#define JRN_NONE        0xFF
+
+// Journal variables
+__xdata uint8_t JRN_slot[JRN_KEYS + 1];         // slot of latest record per key
+__xdata uint8_t JRN_temp[JRN_DATA];             // buffer for moving records
+__xdata uint8_t JRN_head = 0;                   // slot of latest record
+__xdata uint8_t JRN_seq  = 0;                   // sequence number of latest record
+
+// ===================================================================================
+// Journal Helper Functions
+// ===================================================================================
+
+// Calculate CRC-8 (polynomial 0x07, init 0xFF) over sequence number, key and data
+uint8_t JRN_crc(uint8_t addr, uint8_t key) {
+  uint8_t crc = 0xFF;
+  uint8_t i, j;
+  for(i=0; i<JRN_RECORD-1; i++) {
+    crc ^= (i == 1) ? key : FLASH_read(addr + i);
+    for(j=8; j; j--) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+  }
+  return crc;
+}
+
+// Check if slot holds the latest record of any key
+uint8_t JRN_isLive(uint8_t slot) {
+  uint8_t key;
+  for(key=1; key<=JRN_KEYS; key++) if(JRN_slot[key] == slot) return 1;
+  return 0;
+}
+
+// Write record into the next free slot
+void JRN_append(uint8_t key, __xdata uint8_t *buf) {
+  uint8_t slot = JRN_head;
+  uint8_t addr, i;
+  do {                                          // search next slot without
+    if(++slot == JRN_SLOTS) slot = 0;           // latest record of any key
+  } while(JRN_isLive(slot));
+  addr = slot * JRN_RECORD;
+  FLASH_update(addr + 1, 0);                    // invalidate slot
+  FLASH_update(addr, ++JRN_seq);                // write sequence number
+  for(i=0; i<JRN_DATA; i++) FLASH_update(addr + 2 + i, buf[i]); // write data
+  FLASH_update(addr + JRN_RECORD - 1, JRN_crc(addr, key));     // write CRC
+  FLASH_update(addr + 1, key);                  // write key last -> record valid
+  JRN_slot[key] = slot;
+  JRN_head      = slot;
+}
+
+// Copy latest record of key into the next free slot
+void JRN_move(uint8_t key) {
+  uint8_t addr = JRN_slot[key] * JRN_RECORD + 2;
+  uint8_t i;
+  for(i=0; i<JRN_DATA; i++) JRN_temp[i] = FLASH_read(addr + i);
+  JRN_append(key, JRN_temp);
+}
+
+// ===================================================================================
+// Journal Functions
+// ===================================================================================
+
+// Scan data flash and find the latest record of each key
+void JRN_init(void) {
+  uint8_t slot, key, seq, addr;
+  uint8_t found = 0;
+  JRN_head = 1;                                 // empty: start behind legacy layout
+  for(key=0; key<=JRN_KEYS; key++) JRN_slot[key] = JRN_NONE;
+  for(slot=0; slot<JRN_SLOTS; slot++) {
+    addr = slot * JRN_RECORD;
+    key  = FLASH_read(addr + 1);
+    if(!key || (key > JRN_KEYS)) continue;      // invalid key?
+    if(FLASH_read(addr + JRN_RECORD - 1) != JRN_crc(addr, key)) continue; // CRC error?
+    seq  = FLASH_read(addr);
+    if((JRN_slot[key] == JRN_NONE)              // latest record of this key?
+       || ((int8_t)(seq - FLASH_read(JRN_slot[key] * JRN_RECORD)) > 0))
+      JRN_slot[key] = slot;
+    if(!found || ((int8_t)(seq - JRN_seq) > 0)) {  // latest record of all?
+      JRN_seq  = seq;
+      JRN_head = slot;
+      found    = 1;
+    }
+  }
+}
+
+// Copy data of latest record of key into buffer, return 0 if there is none
+uint8_t JRN_read(uint8_t key, __xdata uint8_t *buf) {
+  uint8_t addr, i;
+  if(JRN_slot[key] == JRN_NONE) return 0;
+  addr = JRN_slot[key] * JRN_RECORD + 2;
+  for(i=JRN_DATA; i; i--) *buf++ = FLASH_read(addr++);
+  return 1;
+}
+
+// Append record with data from buffer, if it differs from the latest record of key
+void JRN_write(uint8_t key, __xdata uint8_t *buf) {
+  uint8_t addr, i, k, slot;
+
+  // Skip unchanged data
+  if(JRN_slot[key] != JRN_NONE) {
+    addr = JRN_slot[key] * JRN_RECORD + 2;
+    for(i=0; i<JRN_DATA; i++) if(FLASH_read(addr + i) != buf[i]) break;
+    if(i == JRN_DATA) return;
+  }
+
+  // Move along the record of another key that blocks the next slot, so that the
+  // write position keeps rotating across all slots even if only a few are free
+  slot = JRN_head + 1;
+  if(slot == JRN_SLOTS) slot = 0;
+  for(k=1; k<=JRN_KEYS; k++) {
+    if((k == key) || (JRN_slot[k] != slot)) continue;
+    JRN_move(k);
+    break;
+  }
+
+  // Move along records of other keys that are getting too old
+  for(k=1; k<=JRN_KEYS; k++) {
+    if((k == key) || (JRN_slot[k] == JRN_NONE)) continue;
+    addr = JRN_slot[k] * JRN_RECORD;
+    if((uint8_t)(JRN_seq - FLASH_read(addr)) < JRN_MAX_AGE) continue;
+    JRN_move(k);
+  }
+
+  // Write new record
+  JRN_append(key, buf);
+}
@@ -0,0 +1,40 @@
+// ===================================================================================
+// Wear-Leveling Settings Journal in Data Flash                               * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// JRN_init()               scan data flash and find the latest record of each key
+// JRN_read(key, buf)       copy data of latest record into buf, 0 if none
+// JRN_write(key, buf)      append record with data from buf (only if changed)
+//
+// The 128-byte data flash is split into JRN_SLOTS records of 16 bytes:
+//
+// byte  0     1     2 - 14        15
+//      [seq] [key] [data (13)]   [CRC-8 over bytes 0 - 14]
+//
+// A record is never overwritten in place. A new record is written into the next
+// slot that does not hold the latest record of any key, so the write position
+// rotates across the data flash and a power loss during writing never destroys
+// the previous version: the key is cleared first and written last, after data and
+// CRC, so an incomplete record is ignored.
+// Superseded records are reclaimed as the write position passes by. A record of
+// another key in the slot right after the write position is moved along first, so
+// records that never change do not pin their slots and the wear is spread across all
+// slots even if only a few are free. Records that have not changed for a long time
+// are moved along as well, so the sequence numbers of all records stay within a
+// window that allows wrap-around comparison. Up to
+// JRN_SLOTS - 1 keys (1 ... JRN_KEYS) can be stored.
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+#define JRN_SLOTS       8                       // number of record slots
+#define JRN_RECORD      16                      // record size in bytes
+#define JRN_DATA        13                      // data bytes per record
+
+// Journal functions
+void JRN_init(void);                            // scan journal
+uint8_t JRN_read(uint8_t key, __xdata uint8_t *buf);  // read latest record
+void JRN_write(uint8_t key, __xdata uint8_t *buf);    // append record if changed
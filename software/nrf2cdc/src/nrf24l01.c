@@ -6,7 +6,7 @@
 
 #include "nrf24l01.h"
 #include "spi.h"
-#include "delay.h"
+#include "timer.h"
 
 // ===================================================================================
 // nRF24L01+ Implementation - Definitions and Variables
@@ -20,6 +20,7 @@
 #define NRF_REG_RF_CH         0x05              // RF frequency channel
 #define NRF_REG_RF_SETUP      0x06              // RF setup register
 #define NRF_REG_STATUS        0x07              // status register
+#define NRF_REG_OBSERVE_TX    0x08              // transmit observe register
 #define NRF_REG_RX_ADDR_P0    0x0A              // RX address pipe 0
 #define NRF_REG_RX_ADDR_P1    0x0B              // RX address pipe 1
 #define NRF_REG_TX_ADDR       0x10              // TX address
@@ -33,15 +34,25 @@
 #define NRF_CMD_W_TX_PAYLOAD  0xA0              // write TX payload
 #define NRF_CMD_FLUSH_TX      0xE1              // flush TX FIFO
 #define NRF_CMD_FLUSH_RX      0xE2              // flush RX FIFO
+#define NRF_CMD_NOP           0xFF              // no operation (read status)
 
 // NRF global variables
 __xdata uint8_t NRF_channel   = 0x02;           // channel (0x00 - 0x7F)
 __xdata uint8_t NRF_speed     = 0;              // 0:250kbps, 1:1Mbps, 2:2Mbps
 __xdata uint8_t NRF_tx_addr[] = {0xE7, 0xE7, 0xE7, 0xE7, 0xE7};
 __xdata uint8_t NRF_rx_addr[] = {0xC2, 0xC2, 0xC2, 0xC2, 0xC2};
+uint8_t NRF_pipe              = 0;              // pipe number of last read payload
+__xdata uint8_t NRF_retransmits = 0;            // retransmits of last transmission
+__xdata uint8_t NRF_period    = 0;              // duty cycle period in 10ms (0: off)
+__xdata uint8_t NRF_window    = 2;              // duty cycle RX window in ms
+__xdata uint16_t NRF_dutyTicks = 0;             // duty cycle period in ms
+volatile uint16_t NRF_dutyCount = 0;            // ms since start of current period
+volatile __bit NRF_listening  = 0;              // RX mode, CE driven by duty cycle
+__bit NRF_poweredDown = 1;                      // NRF needs start-up time
 __code uint8_t  NRF_SETUP[]   = {0x26, 0x06, 0x0E};
 __code uint8_t* NRF_STR[]     = {"250k", "1M", "2M"};
-__xdata options_t options = 0;
+options_t options = 0;                          // in internal RAM, checked per packet
+volatile __bit NRF_irqFlag    = 1;              // IRQ pin event (check once at start)
 
 // ===================================================================================
 // nRF24L01+ Implementation - SPI Communication Functions
@@ -51,11 +62,17 @@ __xdata options_t options = 0;
 void NRF_init(void) {
   SPI_init();
   NRF_configure();
+  GPIO_IE = bIE_IO_EDGE | bIE_P3_1_LO;                  // interrupt on falling IRQ pin
+  IE_GPIO = 1;                                          // enable GPIO interrupt
+}
 
-  #ifdef USE_NRF_INT
-  IE_GPIO = 1;
-  GPIO_IE = bIE_IO_EDGE | bIE_P3_1_LO;
-  #endif
+// NRF duty cycle timer handler, switches RX window on and off (call every ms)
+void NRF_tick(void) __using(TMR_BANK) {
+  if(!NRF_period || !NRF_listening) return;             // continuous RX or not listening
+  if(!PIN_read(PIN_IRQ)) NRF_dutyCount = 0;             // packet received -> extend window
+  else if(++NRF_dutyCount == NRF_dutyTicks) NRF_dutyCount = 0; // start next period
+  if(NRF_dutyCount < NRF_window) PIN_high(PIN_CE);      // RX window: listen
+  else PIN_low(PIN_CE);                                 // otherwise Standby-I
 }
 
 // NRF send a command
@@ -65,6 +82,15 @@ void NRF_writeCommand(uint8_t cmd) {
   PIN_high(PIN_CSN);
 }
 
+// NRF read status register (single byte transaction)
+uint8_t NRF_getStatus(void) {
+  uint8_t status;
+  PIN_low(PIN_CSN);
+  status = SPI_transfer(NRF_CMD_NOP);
+  PIN_high(PIN_CSN);
+  return status;
+}
+
 // NRF write one byte into the specified register
 void NRF_writeRegister(uint8_t reg, uint8_t value) {
   PIN_low(PIN_CSN);
@@ -88,7 +114,7 @@ void NRF_writeBuffer(uint8_t reg, __xdata uint8_t *buf, uint8_t len) {
   if(reg < 0x20) reg += 0x20;
   PIN_low(PIN_CSN);
   SPI_transfer(reg);
-  while(len--) SPI_transfer(*buf++);
+  SPI_writeBuffer(buf, len);
   PIN_high(PIN_CSN);
 }
 
@@ -96,7 +122,7 @@ void NRF_writeBuffer(uint8_t reg, __xdata uint8_t *buf, uint8_t len) {
 void NRF_readBuffer(uint8_t reg, __xdata uint8_t *buf, uint8_t len) {
   PIN_low(PIN_CSN);
   SPI_transfer(reg);
-  while(len--) *buf++ = SPI_transfer(0);
+  SPI_readBuffer(buf, len);
   PIN_high(PIN_CSN);
 }
 
@@ -106,8 +132,23 @@ void NRF_readBuffer(uint8_t reg, __xdata uint8_t *buf, uint8_t len) {
 
 // NRF switch to Power Down
 void NRF_powerDown(void) {
+  NRF_listening = 0;                                    // stop duty cycle
   PIN_low(PIN_CE);                                      // return to Standby-I
   NRF_writeRegister(NRF_REG_CONFIG, NRF_CONFIG | 0x00); // !PWR_UP
+  NRF_poweredDown = 1;
+}
+
+// NRF start the start-up time if it was powered down (call after setting PWR_UP)
+void NRF_powerUp(void) {
+  if(NRF_poweredDown) {
+    TMR_start(TMR_NRF, 3);                              // 1.5ms (+1 tick) start-up
+    NRF_poweredDown = 0;
+  }
+}
+
+// NRF check if start-up time after power down has passed (ready to transmit)
+uint8_t NRF_ready(void) {
+  return !TMR_running(TMR_NRF);
 }
 
 // NRF switch to RX mode
@@ -115,22 +156,29 @@ void NRF_powerRX(void) {
   PIN_low(PIN_CE);                                      // return to Standby-I
   //DLY_us(100);
   NRF_writeRegister(NRF_REG_CONFIG, NRF_CONFIG | 0x03); // PWR_UP + PRIM_RX
-  PIN_high(PIN_CE);                                     // switch to RX Mode
-  DLY_us(200);
+  NRF_powerUp();                                        // start-up time if needed
+  PIN_high(PIN_CE);                                     // switch to RX Mode (130us
+  NRF_dutyCount = 0;                                    // settling, no need to wait)
+  NRF_listening = 1;                                    // start duty cycle
 }
 
+#if FEATURE_TX
 // NRF switch to TX mode
 void NRF_powerTX(void) {
+  NRF_listening = 0;                                    // stop duty cycle
   PIN_low(PIN_CE);                                      // return to Standby-I
   NRF_writeRegister(NRF_REG_CONFIG, NRF_CONFIG | 0x02); // PWR_UP + !PRIM_RX
-  PIN_high(PIN_CE);                                     // switch to TX Mode
-  DLY_us(200);
-  //PIN_low(PIN_CE);
+  NRF_powerUp();                                        // start-up time if needed
+  PIN_high(PIN_CE);                                     // switch to TX Mode (sends
+  //PIN_low(PIN_CE);                                    // after 130us settling)
 }
+#endif
 
 // NRF configure
 void NRF_configure(void) {
+  NRF_listening = 0;                                    // stop duty cycle
   PIN_low(PIN_CE);                                      // leave active mode
+  NRF_dutyTicks = (uint16_t)NRF_period * 10;            // duty cycle period in ms
   NRF_writeBuffer(NRF_REG_RX_ADDR_P1, NRF_rx_addr, 5);  // set RX address
   NRF_writeBuffer(NRF_REG_TX_ADDR,    NRF_tx_addr, 5);  // set TX address
   NRF_writeBuffer(NRF_REG_RX_ADDR_P0, NRF_tx_addr, 5);  // set TX address for auto-ACK
@@ -140,6 +188,7 @@ void NRF_configure(void) {
   NRF_writeRegister(NRF_REG_DYNPD,    (options & DYNAMIC_PAYLOAD) ? 0x3F : 00);            // enable dynamic payload length
   NRF_writeRegister(NRF_REG_SETUP_AW, 0x03);            // Address width of 5
   NRF_writeCommand(NRF_CMD_FLUSH_RX);                   // flush RX FIFO
+  NRF_writeRegister(NRF_REG_STATUS, 0x70);              // clear flags -> release IRQ pin
   NRF_writeRegister(NRF_REG_EN_AA, (options & AUTO_ACK) ? 0x3F : 0x00);   // auto-ack all pipes
   NRF_writeRegister(NRF_REG_SETUP_RETR, 0x4F);
   NRF_powerRX();                                        // switch to RX Mode
@@ -166,20 +215,71 @@ uint8_t NRF_available(void) {
   return(!(NRF_readRegister(NRF_REG_FIFO_STATUS) & 0x01));
 }
 
-// Read payload bytes into buffer, return payload length
-uint8_t NRF_readPayload(__xdata uint8_t *buf) {
-  uint8_t len = NRF_readRegister(NRF_CMD_R_RX_PL_WID);  // read payload length
+// Get length (and pipe number) of next payload in RX FIFO, 0 if it was corrupt
+uint8_t NRF_payloadLength(void) {
+  uint8_t len;
+  PIN_low(PIN_CSN);
+  NRF_pipe = (SPI_transfer(NRF_CMD_R_RX_PL_WID) >> 1) & 0x07; // status -> pipe number
+  len = SPI_transfer(0);                                // read payload length
+  PIN_high(PIN_CSN);
+  if(len > NRF_PAYLOAD) {                               // corrupt payload?
+    NRF_writeCommand(NRF_CMD_FLUSH_RX);                 // -> discard it
+    NRF_writeRegister(NRF_REG_STATUS, 0x40);            // reset status register
+    len = 0;
+  }
+  return len;                                           // return payload length
+}
+
+// Read payload of given length into buffer (e.g. directly into the USB buffer)
+void NRF_fetchPayload(__xdata uint8_t *buf, uint8_t len) {
+  if(!len) return;                                      // nothing to read
   NRF_readBuffer(NRF_CMD_R_RX_PAYLOAD, buf, len);       // read payload
   NRF_writeRegister(NRF_REG_STATUS, 0x40);              // reset status register
+}
+
+// Read payload bytes into buffer, return payload length
+uint8_t NRF_readPayload(__xdata uint8_t *buf) {
+  uint8_t len = NRF_payloadLength();                    // get payload length
+  NRF_fetchPayload(buf, len);                           // read payload
   return len;                                           // return payload length
 }
 
-// Send a data package (max length 32)
-void NRF_writePayload(__xdata uint8_t *buf, uint8_t len) {
+#if FEATURE_TX
+// Set TX address and RX address of pipe 0 (for auto-ACK), leaves NRF in Standby-I
+void NRF_setTXaddress(__xdata uint8_t *addr) {
+  NRF_listening = 0;                                    // stop duty cycle
+  PIN_low(PIN_CE);                                      // return to Standby-I
+  NRF_writeBuffer(NRF_REG_TX_ADDR,    addr, 5);         // set TX address
+  NRF_writeBuffer(NRF_REG_RX_ADDR_P0, addr, 5);         // set TX address for auto-ACK
+}
+
+// Start sending a data package (max length 32), don't wait until finished
+// (check NRF_ready() before, if the NRF may have been powered down)
+void NRF_startTX(__xdata uint8_t *buf, uint8_t len) {
   NRF_writeRegister(NRF_REG_STATUS, 0x30);              // clear status flags
   NRF_writeCommand(NRF_CMD_FLUSH_TX);                   // flush TX FIFO
   NRF_powerTX();                                        // switch to TX Mode
   NRF_writeBuffer(NRF_CMD_W_TX_PAYLOAD, buf, len);      // write payload and transmit
-  while(!(NRF_readRegister(NRF_REG_STATUS) & 0x30));    // wait until finished
-  NRF_powerRX();                                        // return to listening
 }
+
+// Check if sending is finished; if so, return to listening and report result
+uint8_t NRF_pollTX(void) {
+  uint8_t status = NRF_getStatus() & 0x30;              // TX_DS or MAX_RT set?
+  if(status) {
+    NRF_retransmits = NRF_readRegister(NRF_REG_OBSERVE_TX) & 0x0F;
+    NRF_writeRegister(NRF_REG_STATUS, 0x30);            // clear status flags
+    if(status & NRF_TX_FAILED) NRF_writeCommand(NRF_CMD_FLUSH_TX); // discard payload
+    NRF_powerRX();                                      // return to listening
+  }
+  return status;
+}
+
+// Send a data package (max length 32) and wait until finished
+uint8_t NRF_writePayload(__xdata uint8_t *buf, uint8_t len) {
+  uint8_t status;
+  while(!NRF_ready());                                  // wait for start-up
+  NRF_startTX(buf, len);                                // start sending
+  while(!(status = NRF_pollTX()));                      // wait until finished
+  return status;
+}
+#endif
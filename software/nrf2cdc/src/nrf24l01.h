@@ -7,13 +7,18 @@
 #pragma once
 #include <stdint.h>
 #include "gpio.h"
+#include "timer.h"
 #include "config.h"
 
 typedef enum class {
   HEX_MODE = 0x80,
   STRIP_LINE_ENDS = 0x40,
   AUTO_ACK = 0x20,
-  DYNAMIC_PAYLOAD = 0x10
+  DYNAMIC_PAYLOAD = 0x10,
+  BINARY_MODE = 0x08,
+  RAW_MODE = 0x04,
+  WAKE_ON_PACKET = 0x02,
+  BURST_MODE = 0x01
 } options_t;
 
 // NRF variables
@@ -21,15 +26,39 @@ extern __xdata uint8_t NRF_channel;             // channel (0x00 - 0x7F)
 extern __xdata uint8_t NRF_speed;               // 0:250kbps, 1:1Mbps, 2:2Mbps
 extern __xdata uint8_t NRF_tx_addr[];           // transmit address
 extern __xdata uint8_t NRF_rx_addr[];           // receive address
+extern uint8_t NRF_pipe;                        // pipe number of last read payload
+extern __xdata uint8_t NRF_retransmits;         // retransmits of last transmission
+extern __xdata uint8_t NRF_period;              // duty cycle period in 10ms (0: off)
+extern __xdata uint8_t NRF_window;              // duty cycle RX window in ms
+extern __xdata uint16_t NRF_dutyTicks;          // duty cycle period in ms
 extern __code uint8_t* NRF_STR[];               // speed strings
-extern __xdata options_t options;
+extern options_t options;
+extern volatile __bit NRF_irqFlag;              // set by IRQ pin interrupt
 
 // NRF functions
 void NRF_init(void);                            // init NRF
 void NRF_configure(void);                       // configure NRF
+void NRF_tick(void) __using(TMR_BANK);          // duty cycle handler, call every ms
+uint8_t NRF_getStatus(void);                    // read status register (1-byte transaction)
+void NRF_powerDown(void);                       // switch to power down
+void NRF_powerRX(void);                         // switch to RX mode (listening)
+uint8_t NRF_ready(void);                        // check if start-up time has passed
+
+// IRQ pin interrupt handler (a single bit instruction, no registers are used)
+#define NRF_interrupt()   NRF_irqFlag = 1
 uint8_t NRF_available(void);                    // check if data is available for reading
 uint8_t NRF_readPayload(__xdata uint8_t *buf); // read payload into buffer, return length
-void NRF_writePayload(__xdata uint8_t *buf, uint8_t len);  // send a data package (max length 32)
+uint8_t NRF_payloadLength(void);                // get length of next payload, 0: corrupt
+void NRF_fetchPayload(__xdata uint8_t *buf, uint8_t len); // read payload of known length
+uint8_t NRF_writePayload(__xdata uint8_t *buf, uint8_t len); // send a data package (max length 32)
+void NRF_startTX(__xdata uint8_t *buf, uint8_t len);  // start sending, don't wait
+void NRF_setTXaddress(__xdata uint8_t *addr);  // set TX address without reconfiguration
+uint8_t NRF_pollTX(void);                       // check if sending is finished
+
+// Results of NRF_pollTX() and NRF_writePayload()
+#define NRF_TX_BUSY     0x00                    // transmission still in progress
+#define NRF_TX_DONE     0x20                    // transmitted (and ACK received)
+#define NRF_TX_FAILED   0x10                    // max number of retransmits reached
 uint8_t NRF_readconfig(void);
 uint8_t NRF_readstatus(void);
 uint8_t NRF_readfifostatus(void);
\ No newline at end of file
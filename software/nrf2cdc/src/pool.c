@@ -0,0 +1,59 @@
+// ===================================================================================
+// Fixed-Block Packet Pool                                                    * v1.0 *
+// ===================================================================================
+
+#include "pool.h"
+
+#if POOL_BLOCKS
+
+// Pool variables
+__xdata pool_block_t POOL_blocks[POOL_BLOCKS];  // packet blocks
+uint8_t POOL_freeHead  = POOL_NONE;             // first free block
+uint8_t POOL_freeCount = 0;                     // number of free blocks
+
+// Link all blocks into the free list
+void POOL_init(void) {
+  uint8_t i;
+  for(i=0; i<POOL_BLOCKS-1; i++) POOL_blocks[i].next = i + 1;
+  POOL_blocks[POOL_BLOCKS-1].next = POOL_NONE;
+  POOL_freeHead  = 0;
+  POOL_freeCount = POOL_BLOCKS;
+}
+
+// Take a block from the free list, returns its number or POOL_NONE if none is left
+uint8_t POOL_alloc(void) {
+  uint8_t blk = POOL_freeHead;
+  if(blk != POOL_NONE) {
+    POOL_freeHead = POOL_blocks[blk].next;
+    POOL_freeCount--;
+  }
+  return blk;
+}
+
+// Return block to the free list
+void POOL_free(uint8_t blk) {
+  POOL_blocks[blk].next = POOL_freeHead;
+  POOL_freeHead = blk;
+  POOL_freeCount++;
+}
+
+// Append block to the end of a queue, the queue owns it afterwards
+void POOL_put(__data pool_queue_t *queue, uint8_t blk) {
+  POOL_blocks[blk].next = POOL_NONE;
+  if(queue->count) POOL_blocks[queue->tail].next = blk;
+  else queue->head = blk;
+  queue->tail = blk;
+  queue->count++;
+}
+
+// Remove first block from a queue, returns it (now owned by the caller) or POOL_NONE
+uint8_t POOL_get(__data pool_queue_t *queue) {
+  uint8_t blk = queue->head;
+  if(blk != POOL_NONE) {
+    queue->head = POOL_blocks[blk].next;
+    queue->count--;
+  }
+  return blk;
+}
+
+#endif
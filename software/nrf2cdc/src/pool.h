@@ -0,0 +1,77 @@
+// ===================================================================================
+// Fixed-Block Packet Pool                                                    * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// POOL_init()              link all blocks into the free list
+// POOL_alloc()             take a block from the free list, returns its number or
+//                          POOL_NONE if all blocks are in use
+// POOL_free(blk)           return block to the free list
+// POOL_put(queue, blk)     append block to the end of a queue
+// POOL_get(queue)          remove first block from a queue, returns it or POOL_NONE
+// POOL_first(queue)        first block of a queue (POOL_NONE if empty), not removed
+// POOL_block(blk)          pointer to block (header fields and payload)
+// POOL_data(blk)           pointer to payload of block
+// POOL_available()         number of free blocks
+//
+// The XRAM for radio packets is a single array of POOL_BLOCKS blocks with room for
+// one payload of NRF_PAYLOAD bytes each, instead of a static buffer per data path.
+// A block is owned by exactly one party at a time: the free list, a queue or the
+// code filling or reading it. Blocks are passed on by number (one byte) and linked
+// through their next field, so allocating, freeing, queuing and dequeuing are O(1)
+// without copying the payload and the pool cannot fragment. Whoever writes into a
+// block must limit the data to NRF_PAYLOAD bytes, the next block follows directly.
+//
+// Queues are pool_queue_t variables in internal RAM; each data path (e.g. the TX
+// queue) owns one and takes its blocks from the same pool. The header fields type,
+// token and dest are not used by the pool, the owner of the block may use them to
+// keep information about the packet.
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+#if POOL_BLOCKS
+
+// Block number of no block (end of list, empty queue, pool exhausted)
+#define POOL_NONE       0xFF
+
+// Packet block
+typedef struct {
+  uint8_t next;                                 // next block in free list or queue
+  uint8_t type;                                 // owner's use (e.g. how to report)
+  uint8_t token;                                // owner's use (e.g. host's token)
+  uint8_t dest;                                 // owner's use (e.g. destination)
+  uint8_t len;                                  // payload length
+  uint8_t data[NRF_PAYLOAD];                    // payload
+} pool_block_t;
+
+// Queue of blocks
+typedef struct {
+  uint8_t head;                                 // first block (POOL_NONE: empty)
+  uint8_t tail;                                 // last block
+  uint8_t count;                                // number of blocks in queue
+} pool_queue_t;
+
+// Initializer for queue variables
+#define POOL_QUEUE      {POOL_NONE, POOL_NONE, 0}
+
+// Pool variables
+extern __xdata pool_block_t POOL_blocks[];      // packet blocks
+extern uint8_t POOL_freeCount;                  // number of free blocks
+
+// Pool macros
+#define POOL_block(blk)     (&POOL_blocks[blk])
+#define POOL_data(blk)      (POOL_blocks[blk].data)
+#define POOL_first(queue)   ((queue)->head)
+#define POOL_available()    (POOL_freeCount)
+
+// Pool functions
+void POOL_init(void);                           // link blocks into free list
+uint8_t POOL_alloc(void);                       // take free block
+void POOL_free(uint8_t blk);                    // return block to free list
+void POOL_put(__data pool_queue_t *queue, uint8_t blk); // append block to queue
+uint8_t POOL_get(__data pool_queue_t *queue);   // remove first block from queue
+
+#endif
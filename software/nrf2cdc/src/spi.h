@@ -1,6 +1,17 @@
 // ===================================================================================
-// SPI Master Functions for CH551, CH552 and CH554                            * v1.0 *
+// SPI Master Functions for CH551, CH552 and CH554                            * v1.1 *
 // ===================================================================================
+//
+// Functions available:
+// --------------------
+// SPI_init()               init SPI with defined parameters
+// SPI_transfer(d)          transmit and receive a byte
+// SPI_writeBuffer(b,l)     transmit l bytes from buffer b
+// SPI_readBuffer(b,l)      receive l bytes into buffer b (transmits zeros)
+//
+// At SPI clock Fsys/2, a byte is exchanged in 16 clock cycles, less than the entry
+// and exit of an interrupt. The buffer functions therefore don't use the SPI
+// interrupt, but overlap the buffer access with the transfer of the next byte.
 
 #pragma once
 #include <stdint.h>
@@ -37,3 +48,29 @@ inline uint8_t SPI_transfer(uint8_t data) {
   while(!S0_FREE);                    // wait for transfer to complete
   return SPI0_DATA;                   // return received byte
 }
+
+// SPI transmit bytes from buffer (next byte is fetched while the last one is sent)
+inline void SPI_writeBuffer(__xdata uint8_t *buf, uint8_t len) {
+  uint8_t data;
+  while(len--) {
+    data = *buf++;                    // fetch next byte from buffer
+    while(!S0_FREE);                  // wait for last transfer to complete
+    SPI0_DATA = data;                 // start sending byte
+  }
+  while(!S0_FREE);                    // wait for last transfer to complete
+}
+
+// SPI receive bytes into buffer (last byte is stored while the next one is clocked)
+inline void SPI_readBuffer(__xdata uint8_t *buf, uint8_t len) {
+  uint8_t data;
+  if(!len) return;
+  SPI0_DATA = 0;                      // start receiving first byte
+  while(--len) {
+    while(!S0_FREE);                  // wait for transfer to complete
+    data = SPI0_DATA;                 // get received byte
+    SPI0_DATA = 0;                    // start receiving next byte
+    *buf++ = data;                    // store byte meanwhile
+  }
+  while(!S0_FREE);                    // wait for last transfer to complete
+  *buf = SPI0_DATA;                   // store last byte
+}
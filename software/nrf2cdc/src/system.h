@@ -171,9 +171,11 @@ inline void RST_now(void) {
 // Bootloader (BOOT) Functions
 // ===================================================================================
 inline void BOOT_now(void) {
+  #ifndef SIM_HOST
   __asm
     ljmp #BOOT_LOAD_ADDR
   __endasm;
+  #endif
 }
 
 inline void BOOT_prepare(void) {
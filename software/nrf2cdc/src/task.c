@@ -0,0 +1,58 @@
+// ===================================================================================
+// Cooperative Run-to-Completion Task Scheduler                               * v1.0 *
+// ===================================================================================
+
+#include "task.h"
+#include "timer.h"
+
+// Scheduler variables
+uint8_t TASK_ready = 0;                         // tasks ready to run (bit per task)
+#if TASK_STATS
+__xdata uint16_t TASK_runs[TASKS];              // number of runs per task
+__xdata uint16_t TASK_maxTime[TASKS];           // longest run time per task
+#endif
+
+// Run the ready task with the highest priority to completion, returns its number or
+// TASK_IDLE. Tasks are called through a pointer, which the compiler can't follow, so
+// the local variables must not share memory with those of the tasks
+#pragma save
+#pragma nooverlay
+uint8_t TASK_run(void) {
+  uint8_t t;
+  uint8_t mask = 1;
+  #if TASK_STATS
+  uint16_t start, startms;
+  #endif
+  for(t=0; t<TASKS; t++, mask <<= 1) {
+    if(TASK_ready & mask) {
+      TASK_ready &= ~mask;                      // task runs now
+      #if TASK_STATS
+      startms = TMR_millis();
+      start   = TMR_clocks();
+      #endif
+      TASK_table[t]();                          // run it to completion
+      #if TASK_STATS
+      start = TMR_clocks() - start;             // run time
+      if(!TMR_timeout(startms, 16)) {           // 16-bit clock count didn't wrap?
+        if(start > TASK_maxTime[t]) TASK_maxTime[t] = start;
+      }
+      else TASK_maxTime[t] = 0xFFFF;
+      TASK_runs[t]++;
+      #endif
+      return t;
+    }
+  }
+  return TASK_IDLE;
+}
+#pragma restore
+
+// Restart the run time statistics
+void TASK_clearStats(void) {
+  #if TASK_STATS
+  uint8_t t;
+  for(t=0; t<TASKS; t++) {
+    TASK_runs[t]    = 0;
+    TASK_maxTime[t] = 0;
+  }
+  #endif
+}
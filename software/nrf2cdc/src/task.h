@@ -0,0 +1,49 @@
+// ===================================================================================
+// Cooperative Run-to-Completion Task Scheduler                               * v1.0 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// TASK_post(t)             mark task t as ready to run
+// TASK_pending(t)          check if task t is ready and has not run yet
+// TASK_run()               run the ready task with the highest priority to
+//                          completion, returns its number or TASK_IDLE if none
+// TASK_clearStats()        restart the run time statistics
+//
+// The tasks are plain functions without parameters, listed in TASK_table[] by the
+// application (TASKS, max 8, defined in config.h). The index is the priority: task 0
+// is the most urgent. A task runs to completion and is only interrupted by interrupt
+// handlers, never by another task, so tasks share variables without locking. After
+// each task the scheduler picks the most urgent ready task again. A task should
+// therefore do one bounded piece of work (e.g. one line or one USB packet) and be
+// posted again if there is more to do, then urgent work waits at most for one piece
+// of less urgent work.
+//
+// With TASK_STATS set in config.h, the number of runs and the longest run time of
+// each task are recorded in TASK_runs[] and TASK_maxTime[]. Run times are measured in
+// timer2 clocks (Fsys/4, 0.25us at 16MHz), 0xFFFF stands for 16ms or longer.
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+// Return value of TASK_run() if no task was ready
+#define TASK_IDLE       0xFF
+
+// Task function
+typedef void (*task_t)(void);
+
+// Scheduler variables
+extern __code task_t TASK_table[];              // task functions by priority (application)
+extern uint8_t TASK_ready;                      // tasks ready to run (bit per task)
+#if TASK_STATS
+extern __xdata uint16_t TASK_runs[];            // number of runs per task
+extern __xdata uint16_t TASK_maxTime[];         // longest run time per task
+#endif
+
+// Scheduler functions
+uint8_t TASK_run(void);                         // run most urgent ready task
+void TASK_clearStats(void);                     // restart statistics
+
+#define TASK_post(t)      TASK_ready |= (1 << (t))
+#define TASK_pending(t)   (TASK_ready & (1 << (t)))
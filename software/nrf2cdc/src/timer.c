@@ -0,0 +1,89 @@
+// ===================================================================================
+// Millisecond Timer Functions for CH551, CH552 and CH554                     * v1.3 *
+// ===================================================================================
+
+#include "timer.h"
+
+// Timer reload value for 1ms period at Fsys/4
+#define TMR_CLOCKS      (F_CPU / 4000)
+#define TMR_RELOAD      (65536 - TMR_CLOCKS)
+
+// Timer variables
+volatile uint16_t TMR_ticks = 0;                // milliseconds since start
+volatile __xdata uint16_t TMR_count[TMR_TIMERS];  // remaining ms of software timers
+__xdata uint16_t TMR_period[TMR_TIMERS];        // period of software timers (0: once)
+volatile uint8_t TMR_active = 0;                // software timers running
+volatile uint8_t TMR_flags  = 0;                // software timers expired
+
+// Start timer2 as 1ms time base with interrupt
+void TMR_init(void) {
+  T2MOD  |= bT2_CLK;                            // timer2 clock Fsys/4
+  RCAP2   = TMR_RELOAD;                         // set reload value
+  T2COUNT = TMR_RELOAD;                         // set start value
+  TF2     = 0;                                  // clear interrupt flag
+  ET2     = 1;                                  // enable timer2 interrupt
+  TR2     = 1;                                  // start timer2 (auto-reload mode)
+  EA      = 1;                                  // enable global interrupts
+}
+
+// Get milliseconds since start (read until consistent, the ISR may interfere)
+uint16_t TMR_millis(void) {
+  uint16_t ticks;
+  do {
+    ticks = TMR_ticks;
+  } while(ticks != TMR_ticks);
+  return ticks;
+}
+
+// Get timer2 clocks since start (read until consistent, the counter and the ISR may
+// interfere)
+uint16_t TMR_clocks(void) {
+  uint16_t ticks;
+  uint8_t  hi, lo;
+  do {
+    ticks = TMR_ticks;
+    hi = TH2;
+    lo = TL2;
+  } while((ticks != TMR_ticks) || (hi != TH2));
+  return ticks * TMR_CLOCKS + ((((uint16_t)hi << 8) | lo) - TMR_RELOAD);
+}
+
+// Set software timer t to expire after ms, then every period ms (0: once, ms 0: stop)
+void TMR_set(uint8_t t, uint16_t ms, uint16_t period) {
+  uint8_t mask = 1 << t;
+  ET2 = 0;                                      // no timer interrupt meanwhile
+  TMR_count[t]  = ms;
+  TMR_period[t] = period;
+  TMR_flags    &= ~mask;                        // clear expired flag
+  if(ms) TMR_active |=  mask;                   // start timer
+  else   TMR_active &= ~mask;                   // stop timer
+  ET2 = 1;
+}
+
+// Check if software timer t has expired since last check (clears expired flag)
+uint8_t TMR_expired(uint8_t t) {
+  uint8_t mask = 1 << t;
+  ET2 = 0;                                      // no timer interrupt meanwhile
+  mask &= TMR_flags;
+  TMR_flags &= ~mask;                           // clear expired flag
+  ET2 = 1;
+  return mask;
+}
+
+// Timer2 interrupt handler (called every millisecond)
+#pragma save
+#pragma nooverlay
+void TMR_interrupt(void) __using(TMR_BANK) {
+  uint8_t t;
+  uint8_t mask = 1;
+  TF2 = 0;                                      // clear interrupt flag
+  TMR_ticks++;                                  // increase milliseconds counter
+  for(t=0; t<TMR_TIMERS; t++, mask <<= 1) {     // count down software timers
+    if((TMR_active & mask) && !--TMR_count[t]) {
+      TMR_flags |= mask;                        // timer expired
+      if(TMR_period[t]) TMR_count[t] = TMR_period[t]; // periodic -> restart
+      else TMR_active &= ~mask;                 // one-shot -> stop
+    }
+  }
+}
+#pragma restore
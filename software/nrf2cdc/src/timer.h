@@ -0,0 +1,60 @@
+// ===================================================================================
+// Millisecond Timer Functions for CH551, CH552 and CH554                     * v1.3 *
+// ===================================================================================
+//
+// Functions available:
+// --------------------
+// TMR_init()               start timer2 as 1ms time base with interrupt
+// TMR_millis()             get milliseconds since start (16-bit, wraps around)
+// TMR_clocks()             get timer2 clocks (Fsys/4) since start (16-bit, wraps
+//                          around every 16.384ms at 16MHz) for measuring short times
+// TMR_timeout(start, ms)   check if ms have passed since timestamp start
+// TMR_set(t, ms, period)   set software timer t to expire after ms, then every
+//                          period ms (period 0: one-shot, ms 0: stop)
+// TMR_start(t, ms)         start one-shot software timer t, expires after ms
+// TMR_startPeriodic(t, ms) start periodic software timer t, expires every ms
+// TMR_stop(t)              stop software timer t
+// TMR_running(t)           check if software timer t is still running
+// TMR_expired(t)           check if software timer t has expired since last check
+// TMR_interrupt()          timer2 interrupt handler, must be called by the ISR
+//
+// Timer2 is used in 16-bit auto-reload mode with Fsys/4, so the interrupt is
+// triggered exactly every millisecond. Timeouts should be calculated by subtracting
+// timestamps, e.g. ((uint16_t)(TMR_millis() - start) >= TIMEOUT), this also works
+// on wrap around. TMR_timeout() does exactly this.
+//
+// The software timers (TMR_TIMERS, max 8, defined in config.h) are counted down in
+// the interrupt. An expired timer is remembered until it is checked with
+// TMR_expired(), so nothing has to wait for it. Note that the first period of a
+// timer is 0 to 1 ms shorter than specified, as it starts between two ticks.
+//
+// The timer2 ISR and the functions it calls (TMR_interrupt() and those declared
+// with __using(TMR_BANK)) use register bank TMR_BANK, so the ISR doesn't have to
+// save R0-R7 of the main program.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+#include "config.h"
+
+// Register bank of the timer2 ISR and the functions it calls
+#define TMR_BANK        2
+
+// Timer variables
+extern volatile uint16_t TMR_ticks;             // milliseconds since start
+extern volatile uint8_t TMR_active;             // software timers running
+extern volatile uint8_t TMR_flags;              // software timers expired
+
+// Timer functions
+void TMR_init(void);                            // start 1ms time base
+uint16_t TMR_millis(void);                      // get milliseconds since start
+uint16_t TMR_clocks(void);                      // get timer2 clocks since start
+void TMR_set(uint8_t t, uint16_t ms, uint16_t period); // set software timer
+uint8_t TMR_expired(uint8_t t);                 // check and clear expired flag
+void TMR_interrupt(void) __using(TMR_BANK);     // timer2 interrupt handler
+
+#define TMR_start(t, ms)          TMR_set(t, ms, 0)
+#define TMR_startPeriodic(t, ms)  TMR_set(t, ms, ms)
+#define TMR_stop(t)               TMR_set(t, 0, 0)
+#define TMR_running(t)            (TMR_active & (1 << (t)))
+#define TMR_timeout(start, ms)    ((uint16_t)(TMR_millis() - (start)) >= (ms))
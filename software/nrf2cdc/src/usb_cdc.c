@@ -1,5 +1,5 @@
 // ===================================================================================
-// Basic USB CDC Functions for CH551, CH552 and CH554                         * v1.5 *
+// Basic USB CDC Functions for CH551, CH552 and CH554                         * v1.6 *
 // ===================================================================================
 
 #include "usb_cdc.h"
@@ -18,10 +18,13 @@ __xdata CDC_LINE_CODING_TYPE CDC_lineCoding = {
 
 // Variables
 volatile __xdata uint8_t CDC_controlLineState = 0;  // control line state
-volatile __xdata uint8_t CDC_readByteCount = 0;     // number of data bytes in IN buffer
-volatile __xdata uint8_t CDC_readPointer   = 0;     // data pointer for fetching
-volatile __xdata uint8_t CDC_writePointer  = 0;     // data pointer for writing
+volatile uint8_t CDC_readByteCount = 0;             // number of data bytes in IN buffer
+volatile uint8_t CDC_readPointer   = 0;             // data pointer for fetching
+volatile uint8_t CDC_writePointer  = 0;             // data pointer for writing
 volatile __bit CDC_writeBusyFlag = 0;               // flag of whether upload pointer is busy
+volatile __bit CDC_breakFlag = 0;                   // flag of whether host sent a break
+volatile __bit CDC_notifyBusyFlag = 0;              // flag of whether EP1 is busy
+volatile __bit CDC_suspendFlag = 0;                 // flag of whether host suspended the bus
 
 // CDC class requests
 #define SET_LINE_CODING         0x20  // host configures line coding
@@ -29,6 +32,9 @@ volatile __bit CDC_writeBusyFlag = 0;               // flag of whether upload po
 #define SET_CONTROL_LINE_STATE  0x22  // generates RS-232/V.24 style control signals
 #define SEND_BREAK              0x23  // send break
 
+// CDC class notifications
+#define SERIAL_STATE            0x20  // UART state bitmap
+
 // ===================================================================================
 // Front End Functions
 // ===================================================================================
@@ -51,6 +57,39 @@ void CDC_write(char c) {
   if(CDC_writePointer == EP2_SIZE) CDC_flush();   // flush if buffer full
 }
 
+// Write bytes from buffer to OUT buffer (block copy instead of single characters)
+void CDC_writeBuffer(__xdata uint8_t *buf, uint8_t len) {
+  __xdata uint8_t *ptr;
+  uint8_t cnt;
+  while(len) {
+    while(CDC_writeBusyFlag);                     // wait for ready to write
+    cnt = EP2_SIZE - CDC_writePointer;            // free space in OUT buffer
+    if(cnt > len) cnt = len;                      // restrict to number of bytes
+    len -= cnt;
+    ptr = EP2_buffer + 64 + CDC_writePointer;     // copy bytes into OUT buffer
+    CDC_writePointer += cnt;
+    while(cnt--) *ptr++ = *buf++;
+    if(CDC_writePointer == EP2_SIZE) CDC_flush(); // flush if buffer full
+  }
+}
+
+// Get pointer to len contiguous free bytes in OUT buffer (max 64) for direct writing
+// (e.g. by SPI), the bytes must be appended with CDC_commit() afterwards
+__xdata uint8_t* CDC_reserve(uint8_t len) {
+  while(1) {
+    while(CDC_writeBusyFlag);                     // wait for ready to write
+    if(CDC_writePointer + len <= EP2_SIZE) break; // enough space left?
+    CDC_flush();                                  // no -> flush what's there first
+  }
+  return EP2_buffer + 64 + CDC_writePointer;      // pointer to free space
+}
+
+// Append len bytes written directly into the OUT buffer via CDC_reserve()
+void CDC_commit(uint8_t len) {
+  CDC_writePointer += len;                        // advance write pointer
+  if(CDC_writePointer == EP2_SIZE) CDC_flush();   // flush if buffer full
+}
+
 // Write string to OUT buffer
 void CDC_print(char* str) {
   while(*str) CDC_write(*str++);                  // write each char of string
@@ -74,12 +113,43 @@ char CDC_read(void) {
   return data;
 }
 
+// Get pointer to the unread bytes in IN buffer (CDC_available() of them) for direct
+// reading (e.g. by SPI), the bytes must be released with CDC_skip() afterwards
+__xdata uint8_t* CDC_peek(void) {
+  return EP2_buffer + CDC_readPointer;            // pointer to next unread byte
+}
+
+// Mark len bytes read directly via CDC_peek() as read
+void CDC_skip(uint8_t len) {
+  CDC_readPointer += len;                         // advance read pointer
+  CDC_readByteCount -= len;                       // dec number of bytes in buffer
+  if(!CDC_readByteCount)                          // request new data if empty
+    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES) | UEP_R_RES_ACK;
+}
+
+// Send SERIAL_STATE notification via EP1 interrupt endpoint, return 0 if busy
+uint8_t CDC_notify(uint8_t state) {
+  if(CDC_notifyBusyFlag) return 0;                // previous notification pending?
+  EP1_buffer[0] = USB_REQ_TYP_IN | USB_REQ_TYP_CLASS | USB_REQ_RECIP_INTERF;
+  EP1_buffer[1] = SERIAL_STATE;                   // notification code
+  EP1_buffer[2] = 0; EP1_buffer[3] = 0;           // wValue: 0
+  EP1_buffer[4] = 0; EP1_buffer[5] = 0;           // wIndex: interface 0
+  EP1_buffer[6] = 2; EP1_buffer[7] = 0;           // wLength: 2
+  EP1_buffer[8] = state; EP1_buffer[9] = 0;       // UART state bitmap
+  CDC_notifyBusyFlag = 1;                         // busy for now
+  UEP1_T_LEN = 10;                                // number of bytes to upload
+  UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_ACK;                     // upload notification to host
+  return 1;
+}
+
 // ===================================================================================
 // CDC-Specific USB Handler Functions
 // ===================================================================================
+// (bulk endpoint EP2 handlers are inlined in the USB ISR, see usb_cdc.h)
 
 // Setup/reset CDC endpoints
-void CDC_EP_init(void) {
+void CDC_EP_init(void) __using(USB_BANK) {
   UEP1_DMA    = (uint16_t)EP1_buffer;             // EP1 data transfer address
   UEP2_DMA    = (uint16_t)EP2_buffer;             // EP2 data transfer address
   UEP1_CTRL   = bUEP_AUTO_TOG                     // EP1 Auto flip sync flag
@@ -93,10 +163,11 @@ void CDC_EP_init(void) {
   UEP2_T_LEN  = 0;                                // EP2 nothing to send
   CDC_readByteCount = 0;                          // reset received bytes counter
   CDC_writeBusyFlag = 0;                          // reset write busy flag
+  CDC_notifyBusyFlag = 0;                         // reset notify busy flag
 }
 
 // Handle CLASS SETUP requests
-uint8_t CDC_control(void) {
+uint8_t CDC_control(void) __using(USB_BANK) {
   uint8_t i;
   switch(USB_SetupReq) {
     case GET_LINE_CODING:                         // 0x21  currently configured
@@ -108,13 +179,16 @@ uint8_t CDC_control(void) {
       return 0;
     case SET_LINE_CODING:                         // 0x20  Configure
       return 0;            
+    case SEND_BREAK:                              // 0x23  host sends a break
+      CDC_breakFlag = 1;                          // set break flag
+      return 0;
     default:
       return 0xff;                                // command not supported
   }
 }
 
 // Endpoint 0 CLASS OUT handler
-void CDC_EP0_OUT(void) {
+void CDC_EP0_OUT(void) __using(USB_BANK) {
   uint8_t i;
   if(USB_SetupReq == SET_LINE_CODING) {           // set line coding
     for(i=0; i<((sizeof(CDC_lineCoding)<=USB_RX_LEN)?sizeof(CDC_lineCoding):USB_RX_LEN); i++)
@@ -123,22 +197,15 @@ void CDC_EP0_OUT(void) {
   UEP0_CTRL = bUEP_T_TOG | UEP_T_RES_ACK | UEP_R_RES_ACK;
 }
 
-// Endpoint 1 IN handler
-// No handling is actually necessary here, the auto-NAK is sufficient.
-
-// Endpoint 2 IN handler (bulk data transfer to host completed)
-void CDC_EP2_IN(void) {
-  UEP2_CTRL  = (UEP2_CTRL & ~MASK_UEP_T_RES)
+// Endpoint 1 IN handler (notification transfer to host completed)
+void CDC_EP1_IN(void) __using(USB_BANK) {
+  UEP1_T_LEN = 0;                                 // nothing more to send
+  UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
              | UEP_T_RES_NAK;                     // -> respond NAK for now
-  CDC_writeBusyFlag = 0;                          // clear busy flag
+  CDC_notifyBusyFlag = 0;                         // clear busy flag
 }
 
-// Endpoint 2 OUT handler (bulk data transfer from host completed)
-void CDC_EP2_OUT(void) {
-  if(U_TOG_OK && USB_RX_LEN) {                    // received synchronized packet?
-    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
-              | UEP_R_RES_NAK;                    // not ready to receive more for now
-    CDC_readByteCount = USB_RX_LEN;               // set number of received data bytes
-    CDC_readPointer   = 0;                        // reset read pointer for fetching
-  }
+// USB bus suspend handler (host stopped sending SOFs, called from USB interrupt)
+void CDC_suspend(void) __using(USB_BANK) {
+  CDC_suspendFlag = 1;                            // handled in main loop
 }
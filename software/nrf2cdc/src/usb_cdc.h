@@ -1,5 +1,5 @@
 // ===================================================================================
-// Basic USB CDC Functions for CH551, CH552 and CH554                         * v1.5 *
+// Basic USB CDC Functions for CH551, CH552 and CH554                         * v1.6 *
 // ===================================================================================
 //
 // Functions available:
@@ -8,14 +8,27 @@
 // CDC_available()          get number of bytes in the IN buffer
 // CDC_ready()              check if OUT buffer is ready to be written
 // CDC_read()               read single character from IN buffer
+// CDC_peek()               get pointer to unread bytes in IN buffer
+// CDC_skip(l)              mark l bytes read directly via CDC_peek() as read
 // CDC_write(c)             write single character to OUT buffer
 // CDC_writeflush(c)        write single character to OUT buffer and flush
+// CDC_writeBuffer(b,l)     write l bytes from buffer b to OUT buffer
+// CDC_reserve(l)           get pointer to l contiguous free bytes in OUT buffer
+// CDC_commit(l)            append l bytes written directly via CDC_reserve()
 // CDC_print(s)             write string to OUT buffer
 // CDC_println(s)           write string with newline to OUT buffer and flush
 // CDC_flush()              flush OUT buffer
 // CDC_getDTR()             get DTR flag
 // CDC_getRTS()             get RTS flag
 // CDC_getBAUD()            get BAUD rate
+// CDC_notify(state)        send SERIAL_STATE notification via EP1, 0 if busy
+// CDC_notifyReady()        check if EP1 is ready for a notification
+// CDC_getBREAK()           get BREAK flag (set when host sends a break)
+// CDC_clearBREAK()         clear BREAK flag
+// CDC_getSUSPEND()         get SUSPEND flag (set when host suspends the bus)
+// CDC_clearSUSPEND()       clear SUSPEND flag
+// CDC_EP2_IN()             bulk IN transfer completed (inline, USB ISR only)
+// CDC_EP2_OUT()            bulk OUT transfer completed (inline, USB ISR only)
 //
 // 2022 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -28,7 +41,8 @@
 // ===================================================================================
 // CDC Variables
 // ===================================================================================
-extern volatile __xdata uint8_t CDC_readByteCount;// number of data bytes in IN buffer
+extern volatile uint8_t CDC_readByteCount;   // number of data bytes in IN buffer
+extern volatile uint8_t CDC_readPointer;     // data pointer for fetching
 extern volatile __bit CDC_writeBusyFlag;     // flag of whether upload pointer is busy
 
 // ===================================================================================
@@ -36,7 +50,12 @@ extern volatile __bit CDC_writeBusyFlag;     // flag of whether upload pointer i
 // ===================================================================================
 void CDC_flush(void);             // flush OUT buffer
 char CDC_read(void);              // read single character from IN buffer
+__xdata uint8_t* CDC_peek(void);  // get pointer to unread bytes in IN buffer
+void CDC_skip(uint8_t len);       // mark bytes in IN buffer as read
 void CDC_write(char c);           // write single character to OUT buffer
+void CDC_writeBuffer(__xdata uint8_t *buf, uint8_t len); // write bytes to OUT buffer
+__xdata uint8_t* CDC_reserve(uint8_t len);  // get free space in OUT buffer (max 64)
+void CDC_commit(uint8_t len);     // append bytes written directly into OUT buffer
 void CDC_print(char* str);        // write string to OUT buffer
 void CDC_println(char* str);      // write string with newline to OUT buffer and flush
 
@@ -54,6 +73,35 @@ extern volatile __xdata uint8_t CDC_controlLineState;           // control line
 #define CDC_getDTR()    (CDC_DTR_flag)                          // get DTR flag
 #define CDC_getRTS()    (CDC_RTS_flag)                          // get RTS flag
 
+// ===================================================================================
+// CDC Serial State Notification
+// ===================================================================================
+extern volatile __bit CDC_notifyBusyFlag;                       // EP1 is busy
+uint8_t CDC_notify(uint8_t state);                              // send serial state
+#define CDC_notifyReady()   (!CDC_notifyBusyFlag)               // EP1 ready
+
+#define CDC_STATE_DCD       0x01    // bRxCarrier:  DCD line state
+#define CDC_STATE_DSR       0x02    // bTxCarrier:  DSR line state
+#define CDC_STATE_BREAK     0x04    // bBreak:      break detected (event)
+#define CDC_STATE_RING      0x08    // bRingSignal: ring signal (event)
+#define CDC_STATE_FRAMING   0x10    // bFraming:    framing error (event)
+#define CDC_STATE_PARITY    0x20    // bParity:     parity error (event)
+#define CDC_STATE_OVERRUN   0x40    // bOverRun:    data overrun (event)
+
+// ===================================================================================
+// CDC Break
+// ===================================================================================
+extern volatile __bit CDC_breakFlag;                            // host sent a break
+#define CDC_getBREAK()    (CDC_breakFlag)                       // get BREAK flag
+#define CDC_clearBREAK()  CDC_breakFlag = 0                     // clear BREAK flag
+
+// ===================================================================================
+// CDC Suspend
+// ===================================================================================
+extern volatile __bit CDC_suspendFlag;                          // host suspended the bus
+#define CDC_getSUSPEND()    (CDC_suspendFlag)                   // get SUSPEND flag
+#define CDC_clearSUSPEND()  CDC_suspendFlag = 0                 // clear SUSPEND flag
+
 // ===================================================================================
 // CDC Line Coding
 // ===================================================================================
@@ -66,3 +114,24 @@ typedef struct _CDC_LINE_CODING_TYPE {
 
 extern __xdata CDC_LINE_CODING_TYPE CDC_lineCoding;
 #define CDC_getBAUD()   (CDC_lineCoding.baudrate)
+
+// ===================================================================================
+// CDC Bulk Endpoint Handlers (inlined in the USB ISR, EP2_xxx_direct)
+// ===================================================================================
+
+// Endpoint 2 IN handler (bulk data transfer to host completed)
+inline void CDC_EP2_IN(void) {
+  UEP2_CTRL  = (UEP2_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_NAK;                     // -> respond NAK for now
+  CDC_writeBusyFlag = 0;                          // clear busy flag
+}
+
+// Endpoint 2 OUT handler (bulk data transfer from host completed)
+inline void CDC_EP2_OUT(void) {
+  if(U_TOG_OK && USB_RX_LEN) {                    // received synchronized packet?
+    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
+              | UEP_R_RES_NAK;                    // not ready to receive more for now
+    CDC_readByteCount = USB_RX_LEN;               // set number of received data bytes
+    CDC_readPointer   = 0;                        // reset read pointer for fetching
+  }
+}
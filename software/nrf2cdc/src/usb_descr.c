@@ -37,7 +37,7 @@ __code USB_CFG_DESCR_CDC CfgDescr = {
     .bNumInterfaces     = 2,                      // number of interfaces: 2
     .bConfigurationValue= 1,                      // value to select this configuration
     .iConfiguration     = 0,                      // no configuration string descriptor
-    .bmAttributes       = 0x80,                   // attributes = bus powered, no wakeup
+    .bmAttributes       = 0xA0,                   // attributes = bus powered, remote wakeup
     .MaxPower           = USB_MAX_POWER_mA / 2    // in 2mA units
   },
 
@@ -70,7 +70,7 @@ __code USB_CFG_DESCR_CDC CfgDescr = {
   .functional = {
     0x05,0x24,0x00,0x10,0x01,                     // header functional descriptor
     0x05,0x24,0x01,0x00,0x00,                     // call management functional descriptor
-    0x04,0x24,0x02,0x02,                          // direct line management functional descriptor
+    0x04,0x24,0x02,0x06,                          // direct line management functional descriptor
     0x05,0x24,0x06,0x00,0x01                      // union functional descriptor: CDC IF0, Data IF1
   },
 
@@ -24,7 +24,7 @@
 // USB Endpoint Definitions
 // ===================================================================================
 #define EP0_SIZE        8
-#define EP1_SIZE        8
+#define EP1_SIZE        16
 #define EP2_SIZE        64
 
 #define EP0_BUF_SIZE    EP_BUF_SIZE(EP0_SIZE)
@@ -1,8 +1,9 @@
 // ===================================================================================
-// USB Handler for CH551, CH552 and CH554                                     * v1.5 *
+// USB Handler for CH551, CH552 and CH554                                     * v1.6 *
 // ===================================================================================
 
 #include "usb_handler.h"
+#include "delay.h"
 
 // ===================================================================================
 // Variables
@@ -10,17 +11,19 @@
 volatile uint8_t  USB_SetupReq, USB_SetupTyp, USB_Config, USB_Addr;
 volatile uint16_t USB_SetupLen;
 volatile __bit    USB_ENUM_OK;
+volatile __bit    USB_WAKE_OK;
 __code uint8_t*   USB_pDescr;
 
 // ===================================================================================
 // Setup/Reset Endpoints
 // ===================================================================================
-void USB_EP_init(void) {
+void USB_EP_init(void) __using(USB_BANK) {
   UEP0_DMA    = (uint16_t)EP0_buffer;       // EP0 data transfer address
   UEP0_CTRL   = UEP_R_RES_ACK               // EP0 Manual flip, OUT transaction returns ACK
               | UEP_T_RES_NAK;              // EP0 IN transaction returns NAK
   UEP0_T_LEN  = 0;                          // must be zero at start
   USB_ENUM_OK = 0;                          // reset ENUM flag
+  USB_WAKE_OK = 0;                          // remote wakeup disabled
 
   #ifdef USB_INIT_endpoints
   USB_INIT_endpoints();                     // custom EP init handler
@@ -37,7 +40,9 @@ void USB_init(void) {
   UDEV_CTRL   = bUD_PD_DIS                  // disable UDP/UDM pulldown resistor
               | bUD_PORT_EN;                // enable port, full-speed
 
+  PSW |= (USB_BANK << 3);                   // select register bank of USB handlers
   USB_EP_init();                            // setup endpoints
+  PSW &= ~(USB_BANK << 3);                  // back to main register bank
 
   USB_INT_EN  = bUIE_SUSPEND                // enable device hang interrupt
               | bUIE_TRANSFER               // enable USB transfer completion interrupt
@@ -48,13 +53,34 @@ void USB_init(void) {
   EA          = 1;                          // enable global interrupts
 }
 
+// ===================================================================================
+// USB Remote Wakeup Function
+// ===================================================================================
+// Signal resume to the suspended host, return 0 if not enabled by the host. The bus
+// must have been idle for at least 5 ms since the suspend (checked by the caller)
+uint8_t USB_wakeup(void) {
+  if(!USB_WAKE_OK) return 0;                // remote wakeup not allowed
+  UDEV_CTRL |= bUD_LOW_SPEED;               // drive K-state on the bus ...
+  DLY_ms(2);                                // ... for 1 - 15 ms
+  UDEV_CTRL &= ~bUD_LOW_SPEED;              // return to full-speed
+  return 1;
+}
+
 // ===================================================================================
 // Fast Copy Function
 // ===================================================================================
 // Copy descriptor *USB_pDescr to EP0_buffer using double pointer
 // (Thanks to Ralph Doncaster)
+#ifdef SIM_HOST
+// (plain C for the host simulation)
+void USB_EP0_copyDescr(uint8_t len) __using(USB_BANK) {
+  uint8_t i;
+  for(i=0; i<len; i++) EP0_buffer[i] = USB_pDescr[i];
+  USB_pDescr += len;
+}
+#else
 #pragma callee_saves USB_EP0_copyDescr
-void USB_EP0_copyDescr(uint8_t len) {
+void USB_EP0_copyDescr(uint8_t len) __using(USB_BANK) {
   len;                          // stop unreferenced argument warning
   __asm
     push acc                    ; acc -> stack
@@ -77,13 +103,14 @@ void USB_EP0_copyDescr(uint8_t len) {
     pop  acc                    ; acc <- stack
   __endasm;
 }
+#endif
 
 // ===================================================================================
 // Endpoint EP0 Handlers
 // ===================================================================================
 
 // Endpoint 0 SETUP handler
-void USB_EP0_SETUP(void) {
+void USB_EP0_SETUP(void) __using(USB_BANK) {
   uint8_t len = 0;                                // default is success and upload 0 length
   USB_SetupLen = ((uint16_t)USB_SetupBuf->wLengthH<<8) | (USB_SetupBuf->wLengthL);
   USB_SetupReq = USB_SetupBuf->bRequest;
@@ -180,7 +207,7 @@ void USB_EP0_SETUP(void) {
         break;
 
       case USB_GET_STATUS:
-        EP0_buffer[0] = 0x00;
+        EP0_buffer[0] = USB_WAKE_OK ? 0x02 : 0x00;  // remote wakeup enabled?
         EP0_buffer[1] = 0x00;
         if(USB_SetupLen > 2) USB_SetupLen = 2;
         len = USB_SetupLen;
@@ -190,7 +217,7 @@ void USB_EP0_SETUP(void) {
         if((USB_SetupTyp & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_DEVICE) {
           if(USB_SetupBuf->wValueL == 0x01) {
             if(((uint8_t*)&CfgDescr)[7] & 0x20) {
-              // wake up
+              USB_WAKE_OK = 0;             // disable remote wakeup
             }
             else len = 0xff;               // failed
           }
@@ -208,12 +235,12 @@ void USB_EP0_SETUP(void) {
               UEP1_CTRL = (UEP1_CTRL & ~(bUEP_T_TOG | MASK_UEP_T_RES)) | UEP_T_RES_NAK;
               break;
             #endif
-            #ifdef EP2_OUT_callback
+            #if defined(EP2_OUT_callback) || defined(EP2_OUT_direct)
             case 0x02:
               UEP2_CTRL = (UEP2_CTRL & ~(bUEP_R_TOG | MASK_UEP_R_RES)) | UEP_R_RES_ACK;
               break;
             #endif
-            #ifdef EP2_IN_callback
+            #if defined(EP2_IN_callback) || defined(EP2_IN_direct)
             case 0x82:
               UEP2_CTRL = (UEP2_CTRL & ~(bUEP_T_TOG | MASK_UEP_T_RES)) | UEP_T_RES_NAK;
               break;
@@ -249,7 +276,8 @@ void USB_EP0_SETUP(void) {
       case USB_SET_FEATURE:
         if((USB_SetupTyp & USB_REQ_RECIP_MASK) == USB_REQ_RECIP_DEVICE) {
           if(USB_SetupBuf->wValueL == 0x01) {
-            if( !(((uint8_t*)&CfgDescr)[7] & 0x20) ) len = 0xff;  // failed
+            if(((uint8_t*)&CfgDescr)[7] & 0x20) USB_WAKE_OK = 1;  // enable remote wakeup
+            else len = 0xff;                                      // failed
           }
           else len = 0xff;                                        // failed
         }
@@ -266,12 +294,12 @@ void USB_EP0_SETUP(void) {
                 UEP1_CTRL = (UEP1_CTRL & ~bUEP_T_TOG) | UEP_T_RES_STALL;
                 break;
               #endif
-              #ifdef EP2_OUT_callback
+              #if defined(EP2_OUT_callback) || defined(EP2_OUT_direct)
               case 0x02:
                 UEP2_CTRL = (UEP2_CTRL & ~bUEP_R_TOG) | UEP_R_RES_STALL;
                 break;
               #endif
-              #ifdef EP2_IN_callback
+              #if defined(EP2_IN_callback) || defined(EP2_IN_direct)
               case 0x82:
                 UEP2_CTRL = (UEP2_CTRL & ~bUEP_T_TOG) | UEP_T_RES_STALL;
                 break;
@@ -338,7 +366,7 @@ void USB_EP0_SETUP(void) {
 }
 
 // Endpoint 0 IN handler
-void USB_EP0_IN(void) {
+void USB_EP0_IN(void) __using(USB_BANK) {
   uint8_t len;
 
   #ifdef USB_CLASS_IN_handler
@@ -376,7 +404,7 @@ void USB_EP0_IN(void) {
 }
 
 // Endpoint 0 OUT handler
-void USB_EP0_OUT(void) {
+void USB_EP0_OUT(void) __using(USB_BANK) {
   #ifdef USB_CLASS_OUT_handler
   if((USB_SetupTyp & USB_REQ_TYP_MASK) == USB_REQ_TYP_CLASS) {
     USB_CLASS_OUT_handler();
@@ -397,9 +425,10 @@ void USB_EP0_OUT(void) {
 // ===================================================================================
 // USB Interrupt Service Routine
 // ===================================================================================
+// Called by the USB ISR for all events it doesn't handle directly (EPx_direct)
 #pragma save
 #pragma nooverlay
-void USB_interrupt(void) {
+void USB_interrupt(void) __using(USB_BANK) {
 
   // USB transfer completed interrupt
   if(UIF_TRANSFER) {
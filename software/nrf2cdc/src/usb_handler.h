@@ -1,5 +1,5 @@
 // ===================================================================================
-// USB Handler for CH551, CH552 and CH554                                     * v1.5 *
+// USB Handler for CH551, CH552 and CH554                                     * v1.6 *
 // ===================================================================================
 
 #pragma once
@@ -14,16 +14,25 @@
 extern volatile uint8_t  USB_SetupReq, USB_SetupTyp;
 extern volatile uint16_t USB_SetupLen;
 extern volatile __bit    USB_ENUM_OK;
+extern volatile __bit    USB_WAKE_OK;
 extern __code uint8_t*   USB_pDescr;
 
+// ===================================================================================
+// Register Bank
+// ===================================================================================
+// The USB ISR and every function it calls run in their own register bank, so the
+// ISR doesn't have to save R0-R7 of the main program. These functions must not be
+// called from the main program (except before the USB interrupt is enabled).
+#define USB_BANK        1               // register bank of USB ISR and handlers
+
 // ===================================================================================
 // Custom External USB Handler Functions
 // ===================================================================================
-uint8_t CDC_control(void);
-void CDC_EP_init(void);
-void CDC_EP0_OUT(void);
-void CDC_EP2_IN(void);
-void CDC_EP2_OUT(void);
+uint8_t CDC_control(void) __using(USB_BANK);
+void CDC_EP_init(void) __using(USB_BANK);
+void CDC_EP0_OUT(void) __using(USB_BANK);
+void CDC_EP1_IN(void) __using(USB_BANK);
+void CDC_suspend(void) __using(USB_BANK);
 
 // ===================================================================================
 // USB Handler Defines
@@ -32,17 +41,22 @@ void CDC_EP2_OUT(void);
 #define USB_INIT_endpoints      CDC_EP_init     // custom USB EP init handler
 #define USB_CLASS_SETUP_handler CDC_control     // handle class setup requests
 #define USB_CLASS_OUT_handler   CDC_EP0_OUT     // handle class out transfers
+#define USB_SUSPEND_handler     CDC_suspend     // custom USB suspend handler
 
 // Endpoint callback functions
 #define EP0_SETUP_callback  USB_EP0_SETUP
 #define EP0_IN_callback     USB_EP0_IN
 #define EP0_OUT_callback    USB_EP0_OUT
-#define EP2_IN_callback     CDC_EP2_IN
-#define EP2_OUT_callback    CDC_EP2_OUT
+#define EP1_IN_callback     CDC_EP1_IN
+
+// Endpoints handled directly in the USB ISR before USB_interrupt() is called
+#define EP2_IN_direct                   // CDC_EP2_IN() in usb_cdc.h
+#define EP2_OUT_direct                  // CDC_EP2_OUT() in usb_cdc.h
 
 // ===================================================================================
 // Functions
 // ===================================================================================
 void USB_init(void);
-void USB_interrupt(void);
-void USB_EP0_copyDescr(uint8_t len);
+void USB_interrupt(void) __using(USB_BANK);
+uint8_t USB_wakeup(void);
+void USB_EP0_copyDescr(uint8_t len) __using(USB_BANK);